@@ -25,12 +25,14 @@ FPSDemo::FPSDemo(HINSTANCE instance,
     bool enable4xMsaa)
     : Ruby::App(instance, clientWidth, clientHeight, windowCaption, enable4xMsaa),
     mInputLayout(nullptr),
-    mMesh()
+    mMesh(),
+    mHasHit(false)
 {
     XMMATRIX identity = XMMatrixIdentity();
     DirectX::XMStoreFloat4x4(&mWorld, identity);
-    DirectX::XMStoreFloat4x4(&mView, identity);
     DirectX::XMStoreFloat4x4(&mProj, identity);
+
+    SetPipelined(true);
 }
 
 
@@ -87,23 +89,9 @@ static float lightHeight = 4.0f;
 #include <algorithm>
 
 // SplitGeometry multithreaded
-void FPSDemo::SplitGeometryFast(Ruby::OctreeNode<Ruby::SceneStaticObject>* node)
+void FPSDemo::SplitGeometryFast(Ruby::OctreeNode<Ruby::SceneStaticObject>* node, Ruby::JobCounter* counter)
 {
-    if (node->pChild[0] == nullptr)
-    {
-        Ruby::SplitGeometryEntry data;
-        data.mMesh = mMesh;
-        data.pNode = node;
-        data.mDevice = mDevice;
-        mQueue.AddEntry(&data);
-    }
-    else
-    {
-        for (int i = 0; i < 8; ++i)
-        {
-            SplitGeometryFast(node->pChild[i]);
-        }
-    }
+    Ruby::AddSplitGeometryJobs(mJobs, mMesh, node, counter, nullptr);
 }
 
 bool FPSDemo::Init()
@@ -111,13 +99,6 @@ bool FPSDemo::Init()
     if (!Ruby::App::Init())
         return false;
 
-    HANDLE threadIds[RUBY_MAX_THREAD_COUNT];
-    for (int i = 0; i < RUBY_MAX_THREAD_COUNT; ++i)
-    {
-        DWORD threadId;
-        threadIds[i] = CreateThread(0, 0, ThreadProc, &mQueue, 0, &threadId);
-    }
-
     DebugProfilerBegin(Init);
 
     D3D11_RASTERIZER_DESC fillRasterizerNoneDesc = {};
@@ -131,11 +112,18 @@ bool FPSDemo::Init()
     fillRasterizerNoneDesc.DepthClipEnable = true;
     mDevice->CreateRasterizerState(&fillRasterizerNoneDesc, &mRasterizerStateFrontCull);
 
-    //mMesh = new Ruby::Mesh(mDevice, "./assets/maze.gltf", "./assets/maze.bin", "./");
-    mMesh = new Ruby::Mesh(mDevice, "./assets/op.gltf", "./assets/op.bin", "./");
-    //mMesh = new Ruby::Mesh(mDevice, "./assets/level2.gltf", "./assets/level2.bin", "./");
-    mGunMesh = new Ruby::Mesh(mDevice, "./assets/gun/gun.gltf", "./assets/gun/gun.bin", "./");
-    mCollider = new Ruby::Mesh(mDevice, "./assets/sphere.gltf", "./assets/sphere.bin", "./");
+    // parse the meshes in parallel, the GPU buffers are created after in this thread
+    Ruby::JobCounter loadCounter;
+    FPSDemo* demo = this;
+    //mJobs->Run([demo]() { demo->mMesh = new Ruby::Mesh("./assets/maze.gltf", "./assets/maze.bin"); }, &loadCounter);
+    mJobs->Run([demo]() { demo->mMesh = new Ruby::Mesh("./assets/op.gltf", "./assets/op.bin"); }, &loadCounter);
+    //mJobs->Run([demo]() { demo->mMesh = new Ruby::Mesh("./assets/level2.gltf", "./assets/level2.bin"); }, &loadCounter);
+    mJobs->Run([demo]() { demo->mGunMesh = new Ruby::Mesh("./assets/gun/gun.gltf", "./assets/gun/gun.bin"); }, &loadCounter);
+    mJobs->Run([demo]() { demo->mCollider = new Ruby::Mesh("./assets/sphere.gltf", "./assets/sphere.bin"); }, &loadCounter);
+    mJobs->Wait(&loadCounter);
+
+    Ruby::Mesh* meshes[] = { mMesh, mGunMesh, mCollider };
+    Ruby::UploadMeshes(mDevice, meshes, 3);
 
     
     /*
@@ -154,28 +142,60 @@ bool FPSDemo::Init()
     float centerX = 0;
     float centerZ = 0;
 
-    mScene = new Ruby::Scene(XMFLOAT3(centerX, 0.0f, centerZ), meshDepth * 0.5f, 3);
+    // adaptive octree, only the nodes with more than 512 triangles are subdivided
+    // and they stop when the children half width get smaller than 1
+    mScene = new Ruby::Scene(mMesh, XMFLOAT3(centerX, 0.0f, centerZ), meshDepth * 0.5f, 512, 1.0f);
 
     Ruby::Octree<Ruby::SceneStaticObject>* octree = &mScene->mStaticObjectTree;
     
     DebugProfilerBegin(SplitGeometryFast);
-    SplitGeometryFast(octree->mRoot);
-    mQueue.CompleteAllWork();
+    Ruby::JobCounter splitCounter;
+    SplitGeometryFast(octree->mRoot, &splitCounter);
+    mJobs->Wait(&splitCounter);
+    DebugProfilerEnd(SplitGeometryFast);
 
-    // kills the threads
-    for (int i = 0; i < RUBY_MAX_THREAD_COUNT; ++i)
-    {
-        TerminateThread(threadIds[i], 0);
-        CloseHandle(threadIds[i]);
-    }
+    // the queries run on the linear octree, the build octree is not needed anymore
+    mScene->LinearizeStaticGeometry();
 
-    DebugProfilerEnd(SplitGeometryFast);
+    // the split only produce CPU meshes, upload all of them here in a few shared buffers
+    DebugProfilerBegin(UploadStaticGeometry);
+    mScene->UploadStaticGeometry(mDevice);
+    DebugProfilerEnd(UploadStaticGeometry);
 
     OutputDebugStringA("Mesh split end!!\n");
 
 
     mCamera = new Ruby::FPSCamera(XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, 0), 32.0f);
 
+    // the player collider is the first dynamic object of the scene
+    mPlayerObject = mScene->mDynamicObjectTree.Insert(mCamera->GetPosition(), XMFLOAT3(0.75f, 0.75f, 0.75f), mCollider);
+
+    // the frustums are set in DrawScene before the graph run
+    mCullGraph.AddTask("CullCamera", [demo]()
+    {
+        demo->mVisibleObjects.clear();
+        auto collectVisible = [demo](Ruby::SceneStaticObject* objects, UINT32 count)
+        {
+            for (UINT32 i = 0; i < count; ++i)
+            {
+                demo->mVisibleObjects.push_back(&objects[i]);
+            }
+        };
+        demo->mScene->mStaticObjects.VisitFrustum(demo->mCameraFrustum, collectVisible);
+    });
+    mCullGraph.AddTask("CullShadowCasters", [demo]()
+    {
+        demo->mShadowCasters.clear();
+        auto collectCasters = [demo](Ruby::SceneStaticObject* objects, UINT32 count)
+        {
+            for (UINT32 i = 0; i < count; ++i)
+            {
+                demo->mShadowCasters.push_back(&objects[i]);
+            }
+        };
+        demo->mScene->mStaticObjects.VisitFrustum(demo->mLightFrustum, collectCasters);
+    });
+
     DebugProfilerBegin(HDRTexture);
     // Load HDR Texture
     {
@@ -612,6 +632,21 @@ void FPSDemo::UpdateScene()
     }
 
 
+    // hitscan, keep the last hit so it can be draw
+    if (mInput.MouseButtonJustDown(0))
+    {
+        XMFLOAT3 origin = mCamera->GetPosition();
+        XMFLOAT3 dir = mCamera->GetViewDirection();
+        XMFLOAT3 ray = XMFLOAT3(dir.x * 100.0f, dir.y * 100.0f, dir.z * 100.0f);
+        Ruby::SceneHit hit;
+        if (mScene->Raycast(origin, ray, hit))
+        {
+            mHasHit = true;
+            mLastHit = hit;
+            mLastHitPoint = XMFLOAT3(origin.x + ray.x * hit.t, origin.y + ray.y * hit.t, origin.z + ray.z * hit.t);
+        }
+    }
+
     if (mInput.MouseButtonJustDown(1))
     {
         ShowCursor(false);
@@ -651,17 +686,31 @@ void FPSDemo::FixUpdateScene(float dt)
     //sprintf_s(Buffer, "fix update FPS: %f\n", 1.0f / dt);
     //OutputDebugStringA(Buffer);
 
-    std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*> queryResult;
-    mScene->mStaticObjectTree.mRoot->Query(mCamera->GetPosition(), XMFLOAT3(4, 4, 4), queryResult);
-
-    std::vector<Ruby::Physics::Triangle> triangles;
-    for (int i = 0; i < queryResult.size(); ++i)
+    // only the triangles the player can reach this step: the collider, the ground ray and the movement
+    XMFLOAT3 position = mCamera->GetPosition();
+    XMFLOAT3 velocity = mCamera->GetVelocity();
+    float speed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
+    float reach = 0.75f + 0.15f + speed * dt + 0.1f;
+    Ruby::Physics::Vector3 c = Ruby::Physics::Vector3(position.x, position.y, position.z);
+    Ruby::Physics::Vector3 r = Ruby::Physics::Vector3(reach, reach, reach);
+
+    // the triangles stay in the leaves, we only collect ranges into a buffer that is reused every step
+    mTriangleRanges.clear();
+    Ruby::LinearOctree<Ruby::SceneStaticObject>* tree = &mScene->mStaticObjects;
+    auto collectTriangles = [this, tree, &c, &r](UINT32 leaf)
     {
-        Ruby::SceneStaticObject object = queryResult[i]->pObjList[0];
-        triangles.insert(triangles.end(), object.mTriangles.begin(), object.mTriangles.end());
-    }
+        Ruby::SceneStaticObject* objects = tree->GetObjects(leaf);
+        UINT32 objectCount = tree->GetObjectCount(leaf);
+        for (UINT32 i = 0; i < objectCount; ++i)
+        {
+            objects[i].mBVH.QueryBox(&objects[i].mCollision, c, r, mTriangleRanges);
+        }
+    };
+    tree->Visit(mCamera->GetPosition(), XMFLOAT3(4, 4, 4), collectTriangles);
 
-    mCamera->FixUpdate(dt, triangles.data(), triangles.size());
+    mCamera->FixUpdate(dt, mTriangleRanges.data(), mTriangleRanges.size());
+
+    mScene->mDynamicObjectTree.Move(mPlayerObject, mCamera->GetPosition(), XMFLOAT3(0.75f, 0.75f, 0.75f));
 }
 
 void FPSDemo::PostUpdateScene(float t)
@@ -669,49 +718,66 @@ void FPSDemo::PostUpdateScene(float t)
     // TODO: interpolate the position between frames
     mCamera->PostUpdate(t);
 
-    XMMATRIX V = mCamera->GetView();
-    DirectX::XMStoreFloat4x4(&mView, V);
-    XMFLOAT3 camPos = mCamera->GetPosition();
-    mPbrColorEffect->mEyePosW->SetRawValue(&camPos, 0, sizeof(XMFLOAT3));
-    mPbrTextureEffect->mEyePosW->SetRawValue(&camPos, 0, sizeof(XMFLOAT3));
+    // the frame is draw from this copy, the other render state can be in use by DrawScene
+    FPSRenderState& state = mRenderStates[mSimulationState];
+    DirectX::XMStoreFloat4x4(&state.mView, mCamera->GetView());
+    state.mCamPos = mCamera->GetPosition();
+    state.mCamRot = mCamera->GetRotation();
+    state.mCamDir = mCamera->GetViewDirection();
+    state.mCamRight = mCamera->GetViewRight();
+    state.mCamUp = mCamera->GetViewUp();
+
+    // the dynamic tree change in the fixed updates, so it is query here and not with the culling
+    state.mDynamicCount = mScene->mDynamicObjectTree.Query(state.mCamPos, XMFLOAT3(32, 16, 32),
+                                                           mDynamicObjects, RUBY_MAX_DYNAMIC_OBJECTS);
+    for (UINT32 i = 0; i < state.mDynamicCount; ++i)
+    {
+        mScene->mDynamicObjectTree.GetBounds(mDynamicObjects[i], state.mDynamicCenters[i], state.mDynamicExtents[i]);
+        state.mDynamicMeshes[i] = (Ruby::Mesh*)mScene->mDynamicObjectTree.GetUserData(mDynamicObjects[i]);
+    }
+
+    state.mHasHit = mHasHit;
+    state.mHitPoint = mLastHitPoint;
 }
 
 void FPSDemo::DrawScene()
 {
+    // only read the render state, the simulation of the next frame is running
+    FPSRenderState& state = mRenderStates[mRenderState];
+
+    mPbrColorEffect->mEyePosW->SetRawValue(&state.mCamPos, 0, sizeof(XMFLOAT3));
+    mPbrTextureEffect->mEyePosW->SetRawValue(&state.mCamPos, 0, sizeof(XMFLOAT3));
+
     mImmediateContext->IASetInputLayout(mInputLayout);
     mImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-    // Query the octree
-    std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*> queryResult;
-    mScene->mStaticObjectTree.mRoot->Query(mCamera->GetPosition(), XMFLOAT3(32, 16, 32), queryResult);
+    XMMATRIX lightView = XMMatrixLookAtLH(lightPos, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(-20, 20, -20, 20, 0.0001f, 45.0f);
+    XMMATRIX lightSpaceMatrix = lightView * lightProj;
+
+    // only the leaves inside the camera frustum are draw in the color pass, the shadow
+    // casters come from the light volume. both run in the job threads
+    Ruby::BuildFrustum(XMLoadFloat4x4(&state.mView) * XMLoadFloat4x4(&mProj), mCameraFrustum);
+    Ruby::BuildShadowCasterFrustum(lightSpaceMatrix, mLightFrustum);
+    mCullGraph.Run(mJobs);
 
     mShadowMap->BindDsvAndSetNullRenderTarget(mImmediateContext);
 
     // render the scene to the depth buffer only for shadow calculations
     {
-        XMVECTOR targetPos = XMVectorZero();
-        XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-
-
-        XMMATRIX V = XMMatrixLookAtLH(lightPos, targetPos, up);
-
-        XMMATRIX P = XMMatrixOrthographicOffCenterLH(-20, 20, -20, 20, 0.0001f, 45.0f);
-
-        XMMATRIX lightSpaceMatrix = V * P;
         mDepthEffect->mLightSpaceMatrix->SetMatrix(reinterpret_cast<float*>(&lightSpaceMatrix));
         mPbrColorEffect->mLightSpaceMatrix->SetMatrix(reinterpret_cast<float*>(&lightSpaceMatrix));
         mPbrTextureEffect->mLightSpaceMatrix->SetMatrix(reinterpret_cast<float*>(&lightSpaceMatrix));
 
-
         D3DX11_TECHNIQUE_DESC techDesc;
         mDepthEffect->GetTechnique()->GetDesc(&techDesc);
         for (UINT p = 0; p < techDesc.Passes; ++p)
         {
-            for (int index = 0; index < queryResult.size(); ++index)
+            for (int index = 0; index < mShadowCasters.size(); ++index)
             {
                 XMMATRIX world = XMMatrixTranslation(0, 0, 0);
                 mDepthEffect->mWorld->SetMatrix(reinterpret_cast<float*>(&world));
-                Ruby::SceneStaticObject object = queryResult[index]->pObjList.back();
+                Ruby::SceneStaticObject& object = *mShadowCasters[index];
                 for (UINT i = 0; i < object.mMesh->Mat.size(); ++i)
                 {
                     mDepthEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
@@ -740,7 +806,7 @@ void FPSDemo::DrawScene()
         // Build the view matrix.
 
         // Set constants
-        XMMATRIX viewProj = XMLoadFloat4x4(&mView) * XMLoadFloat4x4(&mProj);
+        XMMATRIX viewProj = XMLoadFloat4x4(&state.mView) * XMLoadFloat4x4(&mProj);
         D3DX11_TECHNIQUE_DESC techDesc;
         mPbrColorEffect->GetTechnique()->GetDesc(&techDesc);
         for (UINT p = 0; p < techDesc.Passes; ++p)
@@ -751,9 +817,9 @@ void FPSDemo::DrawScene()
             mPbrColorEffect->mWorld->SetMatrix(reinterpret_cast<float*>(&world));
             mPbrColorEffect->mWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
             mPbrColorEffect->mWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
-            for (int index = 0; index < queryResult.size(); ++index)
+            for (int index = 0; index < mVisibleObjects.size(); ++index)
             {
-                Ruby::SceneStaticObject object = queryResult[index]->pObjList.back();
+                Ruby::SceneStaticObject& object = *mVisibleObjects[index];
                 for (UINT i = 0; i < object.mMesh->Mat.size(); ++i)
                 {
                     mPbrColorEffect->mMaterial->SetRawValue(&object.mMesh->Mat[i], 0, sizeof(Ruby::Pbr::Material));
@@ -762,25 +828,49 @@ void FPSDemo::DrawScene()
                 }
             }
             
-            XMFLOAT3 camPos = mCamera->GetPosition();
-            XMFLOAT3 camRot = mCamera->GetRotation();
-            XMFLOAT3 camDir = mCamera->GetViewDirection();
-            XMFLOAT3 camRight = mCamera->GetViewRight();
-            XMFLOAT3 camUp = mCamera->GetViewUp();
-
-            world = XMMatrixScaling(0.75f, 0.75f, 0.75f) * XMMatrixTranslation(camPos.x, camPos.y, camPos.z);
-            worldInvTranspose = InverseTranspose(world);
-            worldViewProj = world * viewProj;
-            mPbrColorEffect->mWorld->SetMatrix(reinterpret_cast<float*>(&world));
-            mPbrColorEffect->mWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
-            mPbrColorEffect->mWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
+            XMFLOAT3 camPos = state.mCamPos;
+            XMFLOAT3 camRot = state.mCamRot;
+            XMFLOAT3 camDir = state.mCamDir;
+            XMFLOAT3 camRight = state.mCamRight;
+            XMFLOAT3 camUp = state.mCamUp;
+
+            // dynamic objects, for now only the player collider
+            for (UINT32 j = 0; j < state.mDynamicCount; ++j)
+            {
+                XMFLOAT3 c = state.mDynamicCenters[j];
+                XMFLOAT3 r = state.mDynamicExtents[j];
+                world = XMMatrixScaling(r.x, r.y, r.z) * XMMatrixTranslation(c.x, c.y, c.z);
+                worldInvTranspose = InverseTranspose(world);
+                worldViewProj = world * viewProj;
+                mPbrColorEffect->mWorld->SetMatrix(reinterpret_cast<float*>(&world));
+                mPbrColorEffect->mWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
+                mPbrColorEffect->mWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
+
+                Ruby::Mesh* mesh = state.mDynamicMeshes[j];
+                for (UINT i = 0; i < mesh->Mat.size(); ++i)
+                {
+                    mPbrColorEffect->mMaterial->SetRawValue(&mesh->Mat[i], 0, sizeof(Ruby::Pbr::Material));
+                    mPbrColorEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
+                    mesh->ModelMesh.Draw(mImmediateContext, i);
+                }
+            }
 
-            Ruby::Mesh*  mesh = mCollider;
-            for (UINT i = 0; i < mesh->Mat.size(); ++i)
+            // the last hit of the gun, the collider sphere made small
+            if (state.mHasHit)
             {
-                mPbrColorEffect->mMaterial->SetRawValue(&mesh->Mat[i], 0, sizeof(Ruby::Pbr::Material));
-                mPbrColorEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
-                mesh->ModelMesh.Draw(mImmediateContext, i);
+                XMFLOAT3 c = state.mHitPoint;
+                world = XMMatrixScaling(0.05f, 0.05f, 0.05f) * XMMatrixTranslation(c.x, c.y, c.z);
+                worldInvTranspose = InverseTranspose(world);
+                worldViewProj = world * viewProj;
+                mPbrColorEffect->mWorld->SetMatrix(reinterpret_cast<float*>(&world));
+                mPbrColorEffect->mWorldInvTranspose->SetMatrix(reinterpret_cast<float*>(&worldInvTranspose));
+                mPbrColorEffect->mWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
+                for (UINT i = 0; i < mCollider->Mat.size(); ++i)
+                {
+                    mPbrColorEffect->mMaterial->SetRawValue(&mCollider->Mat[i], 0, sizeof(Ruby::Pbr::Material));
+                    mPbrColorEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
+                    mCollider->ModelMesh.Draw(mImmediateContext, i);
+                }
             }
 
 
@@ -823,7 +913,7 @@ void FPSDemo::DrawScene()
         mSkyEffect->GetTechnique()->GetDesc(&techDesc);
         for (UINT p = 0; p < techDesc.Passes; ++p)
         {
-            XMFLOAT3 eyePos = mCamera->GetPosition();
+            XMFLOAT3 eyePos = state.mCamPos;
             XMMATRIX world = XMMatrixTranslation(eyePos.x, eyePos.y, eyePos.z);
             XMMATRIX worldViewProj = world * viewProj;
             mSkyEffect->mWorldViewProj->SetMatrix(reinterpret_cast<float*>(&worldViewProj));
@@ -858,6 +948,7 @@ void FPSDemo::DrawScene()
             {
                 mBlurEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
                 mImmediateContext->Draw(6, 0);
+                Ruby::FrameStats::AddDraw(2);
             }
 
             horizontal = !horizontal;
@@ -890,6 +981,7 @@ void FPSDemo::DrawScene()
             {
                 mHdrEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, mImmediateContext);
                 mImmediateContext->Draw(6, 0);
+                Ruby::FrameStats::AddDraw(2);
             }
         }
     }
@@ -7,9 +7,30 @@
 #include "../RubyFrameBuffer.h"
 #include "../RubyScene.h"
 #include "../RubyCamera.h"
-#include "../RubyWorkQueue.h"
+#include "../RubySplitGeometry.h"
 #include "../RubyEffect.h"
 
+// what DrawScene need from the simulation, the simulation write one while the other is draw
+struct FPSRenderState
+{
+    XMFLOAT4X4 mView;
+    XMFLOAT3 mCamPos;
+    XMFLOAT3 mCamRot;
+    XMFLOAT3 mCamDir;
+    XMFLOAT3 mCamRight;
+    XMFLOAT3 mCamUp;
+
+    // the dynamic objects close to the camera
+    UINT32 mDynamicCount;
+    XMFLOAT3 mDynamicCenters[RUBY_MAX_DYNAMIC_OBJECTS];
+    XMFLOAT3 mDynamicExtents[RUBY_MAX_DYNAMIC_OBJECTS];
+    Ruby::Mesh* mDynamicMeshes[RUBY_MAX_DYNAMIC_OBJECTS];
+
+    // where the last shot hit
+    bool mHasHit;
+    XMFLOAT3 mHitPoint;
+};
+
 class FPSDemo : public Ruby::App
 {
 public:
@@ -29,7 +50,7 @@ public:
     void PostUpdateScene(float t);
     void DrawScene();
 
-    void SplitGeometryFast(Ruby::OctreeNode<Ruby::SceneStaticObject>* node);
+    void SplitGeometryFast(Ruby::OctreeNode<Ruby::SceneStaticObject>* node, Ruby::JobCounter* counter);
 
 private:
 
@@ -49,9 +70,10 @@ private:
     ID3D11InputLayout* mInputLayout;
 
     XMFLOAT4X4 mWorld;
-    XMFLOAT4X4 mView;
     XMFLOAT4X4 mProj;
 
+    FPSRenderState mRenderStates[2];
+
     Ruby::MeshGeometry mSky;
     ID3D11Texture2D* mHdrSkyTexture2D;
     ID3D11ShaderResourceView* mHdrSkySRV;
@@ -75,8 +97,23 @@ private:
     Ruby::Pbr::PointLight mPointLight;
 
     Ruby::Scene* mScene;
+    UINT32 mPlayerObject;
 
-    Ruby::FPSCamera* mCamera;
+    // the last thing the gun hit, a small sphere is draw at mLastHitPoint
+    bool mHasHit;
+    Ruby::SceneHit mLastHit;
+    XMFLOAT3 mLastHitPoint;
+
+    // reused every frame so the queries dont allocate
+    std::vector<Ruby::Physics::TriangleRange> mTriangleRanges;
+    std::vector<Ruby::SceneStaticObject*> mVisibleObjects;
+    std::vector<Ruby::SceneStaticObject*> mShadowCasters;
+    UINT32 mDynamicObjects[RUBY_MAX_DYNAMIC_OBJECTS];
 
-    Ruby::SplitGeometryWorkQueue mQueue;
+    // the culling of the frame, they only read the static objects and run at the same time
+    Ruby::TaskGraph mCullGraph;
+    Ruby::Frustum mCameraFrustum;
+    Ruby::Frustum mLightFrustum;
+
+    Ruby::FPSCamera* mCamera;
 };
\ No newline at end of file
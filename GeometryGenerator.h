@@ -15,7 +15,7 @@
 #ifndef GEOMETRYGENERATOR_H
 #define GEOMETRYGENERATOR_H
 
-#include <windows.h>
+#include "RubyTypes.h"
 #include <DirectXMath.h>
 #include <vector>
 
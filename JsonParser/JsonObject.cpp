@@ -1,7 +1,19 @@
 #include "JsonObject.h"
 
-#include <Windows.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+// the saves use WriteFile, on the other platforms hFile is a FILE*
+typedef unsigned long DWORD;
+static bool WriteFile(void* hFile, const void* data, size_t size, DWORD* bytesWriten, void*)
+{
+    *bytesWriten = (DWORD)fwrite(data, 1, size, (FILE*)hFile);
+    return *bytesWriten == size;
+}
+#endif
 
 
 JsonObject::JsonObject()
@@ -263,8 +275,8 @@ void JsonObject::SaveValue(void* hFile)
             } break;
             case VALUE_FLOAT:
             {
-                static char buffer[100];
-                sprintf_s(buffer, "%.*e\0", 16, value->valueFloat);
+                char buffer[100];
+                snprintf(buffer, sizeof(buffer), "%.*e", 16, value->valueFloat);
                 WriteFile(hFile, buffer, strlen(buffer), &bytesWriten, 0);
             } break;
             case VALUE_OBJECT:
@@ -331,6 +343,7 @@ void JsonObject::SaveRoot(void* hFile)
 
 bool JsonObject::SaveToFile(const char* filepath)
 {
+#ifdef _WIN32
     HANDLE hFile = CreateFileA(filepath, GENERIC_WRITE, FILE_SHARE_WRITE, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
 
     if (FAILED(hFile))
@@ -342,6 +355,19 @@ bool JsonObject::SaveToFile(const char* filepath)
     SaveRoot(hFile);
 
     CloseHandle(hFile);
+#else
+    FILE* file = fopen(filepath, "wb");
+
+    if (file == nullptr)
+    {
+        printf("Error: JsonParser::SaveToFile(%s) failed to open/create the file\n", filepath);
+        return false;
+    }
+
+    SaveRoot(file);
+
+    fclose(file);
+#endif
 
     return true;
 }
\ No newline at end of file
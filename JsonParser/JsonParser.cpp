@@ -1,5 +1,11 @@
 #include "JsonParser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 JsonParser::JsonParser() 
 {
@@ -15,6 +21,7 @@ JsonParser::~JsonParser()
 size_t JsonParser::ParseFile(const char* filepath)
 {
 
+#ifdef _WIN32
     HANDLE hFile = CreateFileA(filepath, GENERIC_READ,
         FILE_SHARE_READ, 0, OPEN_EXISTING,
         FILE_ATTRIBUTE_NORMAL, 0);
@@ -43,9 +50,34 @@ size_t JsonParser::ParseFile(const char* filepath)
 
     CloseHandle(hFile);
 
+    size_t fileSize = bytesToRead.QuadPart;
+#else
+    FILE* file = fopen(filepath, "rb");
+
+    if (file == nullptr) {
+        printf("Error openging file: %s\n", filepath);
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long bytesToRead = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (bytesToRead <= 0)
+    {
+        printf("Error file: %s is empty\n", filepath);
+        fclose(file);
+        return 0;
+    }
+
+    char* fileData = new char[bytesToRead];
+    size_t fileSize = fread(fileData, 1, bytesToRead, file);
+
+    fclose(file);
+#endif
+
     JsonScanner* scanner = new JsonScanner();
 
-    scanner->Scan(fileData, bytesToRead.QuadPart);
+    scanner->Scan(fileData, fileSize);
 
     //scanner->PrintTokens();
 
@@ -57,7 +89,7 @@ size_t JsonParser::ParseFile(const char* filepath)
     delete scanner;
     delete[] fileData;
 
-    return bytesToRead.QuadPart;
+    return fileSize;
 }
 
 JsonObject* JsonParser::GetRoot()
@@ -101,7 +133,7 @@ void JsonParser::FillObject(JsonObject* object, std::vector<JsonToken>& tokens,
             JsonValue* newValue = new JsonValue;
             memset(newValue, 0, sizeof(JsonValue));
 
-            static char buffer[32];
+            char buffer[32];
             memcpy(buffer, source + token.offset, token.size);
             buffer[token.size] = '\0';
             newValue->valueFloat = (float)atof(buffer);
@@ -200,7 +232,7 @@ void JsonParser::AddArray(JsonObject* object, std::vector<JsonToken>& tokens, ch
 
             JsonValue* newValue = new JsonValue;
             memset(newValue, 0, sizeof(JsonValue));
-            static char buffer[32];
+            char buffer[32];
             memcpy(buffer, source + token.offset, token.size);
             buffer[token.size] = '\0';
             newValue->valueFloat = (float)atof(buffer);
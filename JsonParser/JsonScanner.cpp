@@ -1,5 +1,9 @@
 #include "JsonScanner.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 static const char* gTokenStrings[] =
 {
     "TOKEN_LEFT_PAREN  ",
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <vector>
 
 enum JsonTokenType
@@ -1,8 +1,9 @@
 #pragma once
 
-#include <windows.h>
 #include <DirectXMath.h>
 
+#include "RubyTypes.h"
+
 using namespace DirectX;
 
 // Note: Make sure structure alignment agrees with HLSL structure padding rules. 
@@ -13,7 +14,7 @@ namespace Ruby {
 
     struct DirectionalLight
     {
-        DirectionalLight() { ZeroMemory(this, sizeof(this)); }
+        DirectionalLight() : Ambient(), Diffuse(), Specular(), Direction(), Pad(0) {}
 
         XMFLOAT4 Ambient;
         XMFLOAT4 Diffuse;
@@ -24,7 +25,7 @@ namespace Ruby {
 
     struct PointLight
     {
-        PointLight() { ZeroMemory(this, sizeof(this)); }
+        PointLight() : Ambient(), Diffuse(), Specular(), Position(), Range(0), Att(), Pad(0) {}
 
         XMFLOAT4 Ambient;
         XMFLOAT4 Diffuse;
@@ -41,7 +42,7 @@ namespace Ruby {
 
     struct SpotLight
     {
-        SpotLight() { ZeroMemory(this, sizeof(this)); }
+        SpotLight() : Ambient(), Diffuse(), Specular(), Position(), Range(0), Direction(), Spot(0), Att(), Pad(0) {}
 
         XMFLOAT4 Ambient;
         XMFLOAT4 Diffuse;
@@ -62,7 +63,7 @@ namespace Ruby {
 
     struct Material
     {
-        Material() { ZeroMemory(this, sizeof(this)); }
+        Material() : Ambient(), Diffuse(), Specular(), Reflect() {}
 
         XMFLOAT4 Ambient;
         XMFLOAT4 Diffuse;
@@ -74,7 +75,7 @@ namespace Ruby {
 
         struct DirectionalLight
         {
-            DirectionalLight() { ZeroMemory(this, sizeof(this)); }
+            DirectionalLight() : Color(), Direction(), Pad(0) {}
             XMFLOAT4 Color;
             XMFLOAT3 Direction;
             float Pad; // Pad the last float so we can set an array of lights if we wanted.
@@ -82,7 +83,7 @@ namespace Ruby {
 
         struct PointLight
         {
-            PointLight() { ZeroMemory(this, sizeof(this)); }
+            PointLight() : Color(), Position(), Pad(0) {}
             XMFLOAT4 Color;
             XMFLOAT3 Position;
             float Pad; // Pad the last float so we can set an array of lights if we wanted.
@@ -92,7 +93,7 @@ namespace Ruby {
 
         struct Material
         {
-            Material() { ZeroMemory(this, sizeof(this)); }
+            Material() : Albedo(), Metallic(0), Roughness(0), Ao(0), Pad(0) {}
             XMFLOAT4 Albedo;
             float Metallic;
             float Roughness;
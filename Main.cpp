@@ -2,8 +2,11 @@
 #include "Demo/FPSDemo.h"
 #include "Demo/PBRDemo.h"
 #include "Demo/BoxDemo.h"
+#include "RubyDebugProfiler.h"
 
 #include <crtdbg.h>
+#include <stdlib.h>
+#include <string.h>
 
 int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
@@ -19,6 +22,13 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     //PBRDemo* app = new PBRDemo(hInstance, 1280, 720, "Ruby Engine: PBR Demo", false);
 
 
+    // -threads N change the number of threads of the job system
+    const char* threads = strstr(lpCmdLine, "-threads");
+    if (threads) app->SetThreadCount((UINT32)atoi(threads + strlen("-threads")));
+    // -capture N save the loading and the first N frames as a Chrome trace
+    const char* capture = strstr(lpCmdLine, "-capture");
+    if (capture) Ruby::DebugProfiler::BeginCapture((UINT32)atoi(capture + strlen("-capture")), RUBY_PROFILER_CAPTURE_PATH);
+
     if (!app->Init())
         return 0;
 
@@ -55,6 +55,17 @@ namespace Ruby { namespace Physics {
 		Plane GetPlane() const;
 	};
 
+    class CollisionMesh;
+
+    // a view of triangles stored somewhere else, so the callers can pass
+    // the triangles of many octree leaves without copying them
+    struct TriangleRange
+    {
+        const CollisionMesh* mesh;
+        int first;
+        int count;
+    };
+
 	struct Point : public Vector3
 	{
 	public:
@@ -79,4 +90,7 @@ namespace Ruby { namespace Physics {
 		real RaycastTriangle(const Triangle& t);
 	};
 
+    // closest points c1 = p1 + (q1 - p1) * s and c2 = p2 + (q2 - p2) * t of two segments, return their square distance
+    float ClosestPtSegmentSegment(Vector3 p1, Vector3 q1, Vector3 p2, Vector3 q2, float& s, float& t, Vector3& c1, Vector3& c2);
+
 }}
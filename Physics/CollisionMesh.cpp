@@ -0,0 +1,445 @@
+#include "CollisionMesh.h"
+
+#include <float.h>
+#include <immintrin.h>
+
+#define RUBY_MT_EPSILON 1e-8f
+
+namespace Ruby { namespace Physics {
+
+    void CollisionMesh::Build(const Triangle* triangles, int count)
+    {
+        mCount = count;
+        mStride = (count + 7) & ~7;
+        mData.assign(STREAM_COUNT * mStride, 0.0f);
+
+        float* s[STREAM_COUNT];
+        for (int i = 0; i < STREAM_COUNT; ++i)
+        {
+            s[i] = mData.data() + i * mStride;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            const Triangle& t = triangles[i];
+            Plane plane = t.GetPlane();
+            Vector3 e0 = t.b - t.a;
+            Vector3 e1 = t.c - t.b;
+            Vector3 e2 = t.a - t.c;
+
+            s[STREAM_AX][i] = t.a.x; s[STREAM_AY][i] = t.a.y; s[STREAM_AZ][i] = t.a.z;
+            s[STREAM_BX][i] = t.b.x; s[STREAM_BY][i] = t.b.y; s[STREAM_BZ][i] = t.b.z;
+            s[STREAM_CX][i] = t.c.x; s[STREAM_CY][i] = t.c.y; s[STREAM_CZ][i] = t.c.z;
+            s[STREAM_NX][i] = plane.n.x; s[STREAM_NY][i] = plane.n.y; s[STREAM_NZ][i] = plane.n.z;
+            s[STREAM_D][i] = plane.d;
+            s[STREAM_E0X][i] = e0.x; s[STREAM_E0Y][i] = e0.y; s[STREAM_E0Z][i] = e0.z;
+            s[STREAM_E1X][i] = e1.x; s[STREAM_E1Y][i] = e1.y; s[STREAM_E1Z][i] = e1.z;
+            s[STREAM_E2X][i] = e2.x; s[STREAM_E2Y][i] = e2.y; s[STREAM_E2Z][i] = e2.z;
+            s[STREAM_MINX][i] = fminf(t.a.x, fminf(t.b.x, t.c.x));
+            s[STREAM_MINY][i] = fminf(t.a.y, fminf(t.b.y, t.c.y));
+            s[STREAM_MINZ][i] = fminf(t.a.z, fminf(t.b.z, t.c.z));
+            s[STREAM_MAXX][i] = fmaxf(t.a.x, fmaxf(t.b.x, t.c.x));
+            s[STREAM_MAXY][i] = fmaxf(t.a.y, fmaxf(t.b.y, t.c.y));
+            s[STREAM_MAXZ][i] = fmaxf(t.a.z, fmaxf(t.b.z, t.c.z));
+        }
+
+        // empty bounds for the padding so nothing ever overlap them
+        for (int i = count; i < mStride; ++i)
+        {
+            s[STREAM_MINX][i] = s[STREAM_MINY][i] = s[STREAM_MINZ][i] = FLT_MAX;
+            s[STREAM_MAXX][i] = s[STREAM_MAXY][i] = s[STREAM_MAXZ][i] = -FLT_MAX;
+        }
+    }
+
+    Triangle CollisionMesh::GetTriangle(int i) const
+    {
+        Triangle t;
+        t.a = Vector3(Stream(STREAM_AX)[i], Stream(STREAM_AY)[i], Stream(STREAM_AZ)[i]);
+        t.b = Vector3(Stream(STREAM_BX)[i], Stream(STREAM_BY)[i], Stream(STREAM_BZ)[i]);
+        t.c = Vector3(Stream(STREAM_CX)[i], Stream(STREAM_CY)[i], Stream(STREAM_CZ)[i]);
+        return t;
+    }
+
+    Plane CollisionMesh::GetPlane(int i) const
+    {
+        Plane plane;
+        plane.n = GetNormal(i);
+        plane.d = Stream(STREAM_D)[i];
+        return plane;
+    }
+
+    Vector3 CollisionMesh::GetNormal(int i) const
+    {
+        return Vector3(Stream(STREAM_NX)[i], Stream(STREAM_NY)[i], Stream(STREAM_NZ)[i]);
+    }
+
+    bool CollisionMesh::PointInTriangle(int i, const Vector3& p) const
+    {
+        Vector3 n = GetNormal(i);
+        Vector3 a = Vector3(Stream(STREAM_AX)[i], Stream(STREAM_AY)[i], Stream(STREAM_AZ)[i]);
+        Vector3 b = Vector3(Stream(STREAM_BX)[i], Stream(STREAM_BY)[i], Stream(STREAM_BZ)[i]);
+        Vector3 c = Vector3(Stream(STREAM_CX)[i], Stream(STREAM_CY)[i], Stream(STREAM_CZ)[i]);
+        Vector3 e0 = Vector3(Stream(STREAM_E0X)[i], Stream(STREAM_E0Y)[i], Stream(STREAM_E0Z)[i]);
+        Vector3 e1 = Vector3(Stream(STREAM_E1X)[i], Stream(STREAM_E1Y)[i], Stream(STREAM_E1Z)[i]);
+        Vector3 e2 = Vector3(Stream(STREAM_E2X)[i], Stream(STREAM_E2Y)[i], Stream(STREAM_E2Z)[i]);
+
+        // the point is inside when it is on the inner side of the three edges
+        if (e0.VectorProduct(p - a).ScalarProduct(n) < 0.0f) return false;
+        if (e1.VectorProduct(p - b).ScalarProduct(n) < 0.0f) return false;
+        if (e2.VectorProduct(p - c).ScalarProduct(n) < 0.0f) return false;
+        return true;
+    }
+
+    real CollisionMesh::RaycastTriangle(int i, const Ray& ray) const
+    {
+        Vector3 n = GetNormal(i);
+        real nd = ray.d.ScalarProduct(n);
+        if (nd >= 0.0f) return -1.0f;
+
+        real t = (Stream(STREAM_D)[i] - ray.o.ScalarProduct(n)) / nd;
+        if (t < 0.0f) return -1.0f;
+
+        if (PointInTriangle(i, ray.o + ray.d * t))
+        {
+            return t;
+        }
+        return -1.0f;
+    }
+
+    int CollisionMesh::CullSweptSphere(int first, int count, const Vector3& c, const Vector3& movement, real r, int* candidates) const
+    {
+        const float* nx = Stream(STREAM_NX);
+        const float* ny = Stream(STREAM_NY);
+        const float* nz = Stream(STREAM_NZ);
+        const float* d = Stream(STREAM_D);
+        const float* minX = Stream(STREAM_MINX);
+        const float* minY = Stream(STREAM_MINY);
+        const float* minZ = Stream(STREAM_MINZ);
+        const float* maxX = Stream(STREAM_MAXX);
+        const float* maxY = Stream(STREAM_MAXY);
+        const float* maxZ = Stream(STREAM_MAXZ);
+
+        float boxMinX = fminf(c.x, c.x + movement.x) - r;
+        float boxMinY = fminf(c.y, c.y + movement.y) - r;
+        float boxMinZ = fminf(c.z, c.z + movement.z) - r;
+        float boxMaxX = fmaxf(c.x, c.x + movement.x) + r;
+        float boxMaxY = fmaxf(c.y, c.y + movement.y) + r;
+        float boxMaxZ = fmaxf(c.z, c.z + movement.z) + r;
+
+        // no branches in the loop so the compiler can vectorize it, the candidates are
+        // always written and the count only move forward when the triangle pass
+        int result = 0;
+        for (int i = first; i < first + count; ++i)
+        {
+            float dist0 = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z - d[i];
+            float dist1 = dist0 + nx[i] * movement.x + ny[i] * movement.y + nz[i] * movement.z;
+            int front = (dist0 > r) & (dist1 > r);
+            int back = (dist0 < -r) & (dist1 < -r);
+            int overlap = (minX[i] <= boxMaxX) & (maxX[i] >= boxMinX) &
+                          (minY[i] <= boxMaxY) & (maxY[i] >= boxMinY) &
+                          (minZ[i] <= boxMaxZ) & (maxZ[i] >= boxMinZ);
+            candidates[result] = i;
+            result += overlap & !(front | back);
+        }
+        return result;
+    }
+
+    // scalar Moller-Trumbore, the same test the SIMD loops do for each lane
+    real CollisionMesh::RaycastMT(int i, const Ray& ray) const
+    {
+        Vector3 a = Vector3(Stream(STREAM_AX)[i], Stream(STREAM_AY)[i], Stream(STREAM_AZ)[i]);
+        Vector3 e1 = Vector3(Stream(STREAM_E0X)[i], Stream(STREAM_E0Y)[i], Stream(STREAM_E0Z)[i]);
+        Vector3 e2 = Vector3(-Stream(STREAM_E2X)[i], -Stream(STREAM_E2Y)[i], -Stream(STREAM_E2Z)[i]);
+
+        Vector3 p = ray.d.VectorProduct(e2);
+        real det = e1.ScalarProduct(p);
+        if (det <= RUBY_MT_EPSILON) return -1.0f;
+        real invDet = 1.0f / det;
+
+        Vector3 s = ray.o - a;
+        real u = s.ScalarProduct(p) * invDet;
+        if (u < 0.0f || u > 1.0f) return -1.0f;
+
+        Vector3 q = s.VectorProduct(e1);
+        real v = ray.d.ScalarProduct(q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+        real t = e2.ScalarProduct(q) * invDet;
+        return t >= 0.0f ? t : -1.0f;
+    }
+
+    real CollisionMesh::RaycastBatch(int first, int count, const Ray& ray, real tMax, int& triangle) const
+    {
+        const float* ax = Stream(STREAM_AX);
+        const float* ay = Stream(STREAM_AY);
+        const float* az = Stream(STREAM_AZ);
+        const float* e1x = Stream(STREAM_E0X);
+        const float* e1y = Stream(STREAM_E0Y);
+        const float* e1z = Stream(STREAM_E0Z);
+        // e2 = c - a = -(a - c)
+        const float* e2x = Stream(STREAM_E2X);
+        const float* e2y = Stream(STREAM_E2Y);
+        const float* e2z = Stream(STREAM_E2Z);
+
+        real result = -1.0f;
+        int i = first;
+        int end = first + count;
+#if defined(__AVX__)
+        {
+            __m256 zero = _mm256_setzero_ps();
+            __m256 one = _mm256_set1_ps(1.0f);
+            __m256 epsilon = _mm256_set1_ps(RUBY_MT_EPSILON);
+            __m256 ox = _mm256_set1_ps(ray.o.x), oy = _mm256_set1_ps(ray.o.y), oz = _mm256_set1_ps(ray.o.z);
+            __m256 dx = _mm256_set1_ps(ray.d.x), dy = _mm256_set1_ps(ray.d.y), dz = _mm256_set1_ps(ray.d.z);
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 ex = _mm256_loadu_ps(e1x + i), ey = _mm256_loadu_ps(e1y + i), ez = _mm256_loadu_ps(e1z + i);
+                __m256 fx = _mm256_sub_ps(zero, _mm256_loadu_ps(e2x + i));
+                __m256 fy = _mm256_sub_ps(zero, _mm256_loadu_ps(e2y + i));
+                __m256 fz = _mm256_sub_ps(zero, _mm256_loadu_ps(e2z + i));
+
+                // p = d x e2, det = e1 . p
+                __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, fz), _mm256_mul_ps(dz, fy));
+                __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, fx), _mm256_mul_ps(dx, fz));
+                __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, fy), _mm256_mul_ps(dy, fx));
+                __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, px), _mm256_mul_ps(ey, py)), _mm256_mul_ps(ez, pz));
+                __m256 valid = _mm256_cmp_ps(det, epsilon, _CMP_GT_OQ);
+                if (_mm256_movemask_ps(valid) == 0) continue;
+                __m256 invDet = _mm256_div_ps(one, det);
+
+                __m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(ax + i));
+                __m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(ay + i));
+                __m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(az + i));
+                __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+
+                // q = s x e1
+                __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, ez), _mm256_mul_ps(sz, ey));
+                __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, ex), _mm256_mul_ps(sx, ez));
+                __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, ey), _mm256_mul_ps(sy, ex));
+                __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+                __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, qx), _mm256_mul_ps(fy, qy)), _mm256_mul_ps(fz, qz)), invDet);
+
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+
+                int mask = _mm256_movemask_ps(valid);
+                if (mask)
+                {
+                    float lanes[8];
+                    _mm256_storeu_ps(lanes, t);
+                    for (int lane = 0; lane < 8; ++lane)
+                    {
+                        if ((mask & (1 << lane)) && lanes[lane] <= tMax)
+                        {
+                            tMax = lanes[lane];
+                            result = lanes[lane];
+                            triangle = i + lane;
+                        }
+                    }
+                }
+            }
+        }
+#endif
+        {
+            __m128 zero = _mm_setzero_ps();
+            __m128 one = _mm_set1_ps(1.0f);
+            __m128 epsilon = _mm_set1_ps(RUBY_MT_EPSILON);
+            __m128 ox = _mm_set1_ps(ray.o.x), oy = _mm_set1_ps(ray.o.y), oz = _mm_set1_ps(ray.o.z);
+            __m128 dx = _mm_set1_ps(ray.d.x), dy = _mm_set1_ps(ray.d.y), dz = _mm_set1_ps(ray.d.z);
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 ex = _mm_loadu_ps(e1x + i), ey = _mm_loadu_ps(e1y + i), ez = _mm_loadu_ps(e1z + i);
+                __m128 fx = _mm_sub_ps(zero, _mm_loadu_ps(e2x + i));
+                __m128 fy = _mm_sub_ps(zero, _mm_loadu_ps(e2y + i));
+                __m128 fz = _mm_sub_ps(zero, _mm_loadu_ps(e2z + i));
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, fz), _mm_mul_ps(dz, fy));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, fx), _mm_mul_ps(dx, fz));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, fy), _mm_mul_ps(dy, fx));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, px), _mm_mul_ps(ey, py)), _mm_mul_ps(ez, pz));
+                __m128 valid = _mm_cmpgt_ps(det, epsilon);
+                if (_mm_movemask_ps(valid) == 0) continue;
+                __m128 invDet = _mm_div_ps(one, det);
+
+                __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(ax + i));
+                __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(ay + i));
+                __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(az + i));
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, ez), _mm_mul_ps(sz, ey));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, ex), _mm_mul_ps(sx, ez));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, ey), _mm_mul_ps(sy, ex));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, qx), _mm_mul_ps(fy, qy)), _mm_mul_ps(fz, qz)), invDet);
+
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(t, _mm_set1_ps(tMax)));
+
+                int mask = _mm_movemask_ps(valid);
+                if (mask)
+                {
+                    float lanes[4];
+                    _mm_storeu_ps(lanes, t);
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        if ((mask & (1 << lane)) && lanes[lane] <= tMax)
+                        {
+                            tMax = lanes[lane];
+                            result = lanes[lane];
+                            triangle = i + lane;
+                        }
+                    }
+                }
+            }
+        }
+        for (; i < end; ++i)
+        {
+            real t = RaycastMT(i, ray);
+            if (t >= 0.0f && t <= tMax)
+            {
+                tMax = t;
+                result = t;
+                triangle = i;
+            }
+        }
+        return result;
+    }
+
+    void CollisionMesh::RaycastPacket(int first, int count, const Ray* rays, int rayCount, real* tHit, int* triangles) const
+    {
+        const float* ax = Stream(STREAM_AX);
+        const float* ay = Stream(STREAM_AY);
+        const float* az = Stream(STREAM_AZ);
+        const float* e1x = Stream(STREAM_E0X);
+        const float* e1y = Stream(STREAM_E0Y);
+        const float* e1z = Stream(STREAM_E0Z);
+        const float* e2x = Stream(STREAM_E2X);
+        const float* e2y = Stream(STREAM_E2Y);
+        const float* e2z = Stream(STREAM_E2Z);
+
+        int r = 0;
+#if defined(__AVX__)
+        for (; r + 8 <= rayCount; r += 8)
+        {
+            // transpose the rays, the triangle data is broadcast
+            const Ray* p = rays + r;
+            __m256 ox = _mm256_set_ps(p[7].o.x, p[6].o.x, p[5].o.x, p[4].o.x, p[3].o.x, p[2].o.x, p[1].o.x, p[0].o.x);
+            __m256 oy = _mm256_set_ps(p[7].o.y, p[6].o.y, p[5].o.y, p[4].o.y, p[3].o.y, p[2].o.y, p[1].o.y, p[0].o.y);
+            __m256 oz = _mm256_set_ps(p[7].o.z, p[6].o.z, p[5].o.z, p[4].o.z, p[3].o.z, p[2].o.z, p[1].o.z, p[0].o.z);
+            __m256 dx = _mm256_set_ps(p[7].d.x, p[6].d.x, p[5].d.x, p[4].d.x, p[3].d.x, p[2].d.x, p[1].d.x, p[0].d.x);
+            __m256 dy = _mm256_set_ps(p[7].d.y, p[6].d.y, p[5].d.y, p[4].d.y, p[3].d.y, p[2].d.y, p[1].d.y, p[0].d.y);
+            __m256 dz = _mm256_set_ps(p[7].d.z, p[6].d.z, p[5].d.z, p[4].d.z, p[3].d.z, p[2].d.z, p[1].d.z, p[0].d.z);
+            __m256 best = _mm256_loadu_ps(tHit + r);
+            // the index is kept as int bits, a float lane is only exact up to 2^24
+            __m256 bestIndex = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+            __m256 zero = _mm256_setzero_ps();
+            __m256 one = _mm256_set1_ps(1.0f);
+            __m256 epsilon = _mm256_set1_ps(RUBY_MT_EPSILON);
+            for (int i = first; i < first + count; ++i)
+            {
+                __m256 ex = _mm256_set1_ps(e1x[i]), ey = _mm256_set1_ps(e1y[i]), ez = _mm256_set1_ps(e1z[i]);
+                __m256 fx = _mm256_set1_ps(-e2x[i]), fy = _mm256_set1_ps(-e2y[i]), fz = _mm256_set1_ps(-e2z[i]);
+
+                __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, fz), _mm256_mul_ps(dz, fy));
+                __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, fx), _mm256_mul_ps(dx, fz));
+                __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, fy), _mm256_mul_ps(dy, fx));
+                __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, px), _mm256_mul_ps(ey, py)), _mm256_mul_ps(ez, pz));
+                __m256 valid = _mm256_cmp_ps(det, epsilon, _CMP_GT_OQ);
+                if (_mm256_movemask_ps(valid) == 0) continue;
+                __m256 invDet = _mm256_div_ps(one, det);
+
+                __m256 sx = _mm256_sub_ps(ox, _mm256_set1_ps(ax[i]));
+                __m256 sy = _mm256_sub_ps(oy, _mm256_set1_ps(ay[i]));
+                __m256 sz = _mm256_sub_ps(oz, _mm256_set1_ps(az[i]));
+                __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+
+                __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, ez), _mm256_mul_ps(sz, ey));
+                __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, ex), _mm256_mul_ps(sx, ez));
+                __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, ey), _mm256_mul_ps(sy, ex));
+                __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+                __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, qx), _mm256_mul_ps(fy, qy)), _mm256_mul_ps(fz, qz)), invDet);
+
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+                valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, best, _CMP_LE_OQ));
+
+                best = _mm256_blendv_ps(best, t, valid);
+                bestIndex = _mm256_blendv_ps(bestIndex, _mm256_castsi256_ps(_mm256_set1_epi32(i)), valid);
+            }
+
+            _mm256_storeu_ps(tHit + r, best);
+            _mm256_storeu_si256((__m256i*)(triangles + r), _mm256_castps_si256(bestIndex));
+        }
+#endif
+        for (; r + 4 <= rayCount; r += 4)
+        {
+            const Ray* p = rays + r;
+            __m128 ox = _mm_set_ps(p[3].o.x, p[2].o.x, p[1].o.x, p[0].o.x);
+            __m128 oy = _mm_set_ps(p[3].o.y, p[2].o.y, p[1].o.y, p[0].o.y);
+            __m128 oz = _mm_set_ps(p[3].o.z, p[2].o.z, p[1].o.z, p[0].o.z);
+            __m128 dx = _mm_set_ps(p[3].d.x, p[2].d.x, p[1].d.x, p[0].d.x);
+            __m128 dy = _mm_set_ps(p[3].d.y, p[2].d.y, p[1].d.y, p[0].d.y);
+            __m128 dz = _mm_set_ps(p[3].d.z, p[2].d.z, p[1].d.z, p[0].d.z);
+            __m128 best = _mm_loadu_ps(tHit + r);
+            __m128 bestIndex = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+            __m128 zero = _mm_setzero_ps();
+            __m128 one = _mm_set1_ps(1.0f);
+            __m128 epsilon = _mm_set1_ps(RUBY_MT_EPSILON);
+            for (int i = first; i < first + count; ++i)
+            {
+                __m128 ex = _mm_set1_ps(e1x[i]), ey = _mm_set1_ps(e1y[i]), ez = _mm_set1_ps(e1z[i]);
+                __m128 fx = _mm_set1_ps(-e2x[i]), fy = _mm_set1_ps(-e2y[i]), fz = _mm_set1_ps(-e2z[i]);
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, fz), _mm_mul_ps(dz, fy));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, fx), _mm_mul_ps(dx, fz));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, fy), _mm_mul_ps(dy, fx));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, px), _mm_mul_ps(ey, py)), _mm_mul_ps(ez, pz));
+                __m128 valid = _mm_cmpgt_ps(det, epsilon);
+                if (_mm_movemask_ps(valid) == 0) continue;
+                __m128 invDet = _mm_div_ps(one, det);
+
+                __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(ax[i]));
+                __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(ay[i]));
+                __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(az[i]));
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, ez), _mm_mul_ps(sz, ey));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, ex), _mm_mul_ps(sx, ez));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, ey), _mm_mul_ps(sy, ex));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, qx), _mm_mul_ps(fy, qy)), _mm_mul_ps(fz, qz)), invDet);
+
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(t, best));
+
+                // SSE2 has no blend
+                best = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, best));
+                bestIndex = _mm_or_ps(_mm_and_ps(valid, _mm_castsi128_ps(_mm_set1_epi32(i))), _mm_andnot_ps(valid, bestIndex));
+            }
+
+            _mm_storeu_ps(tHit + r, best);
+            _mm_storeu_si128((__m128i*)(triangles + r), _mm_castps_si128(bestIndex));
+        }
+        for (; r < rayCount; ++r)
+        {
+            int triangle = -1;
+            real t = RaycastBatch(first, count, rays[r], tHit[r], triangle);
+            if (t >= 0.0f) tHit[r] = t;
+            triangles[r] = triangle;
+        }
+    }
+
+}}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Collision.h"
+
+#define RUBY_COLLISION_CHUNK 64
+
+namespace Ruby { namespace Physics {
+
+    enum CollisionStream
+    {
+        STREAM_AX, STREAM_AY, STREAM_AZ,
+        STREAM_BX, STREAM_BY, STREAM_BZ,
+        STREAM_CX, STREAM_CY, STREAM_CZ,
+        STREAM_NX, STREAM_NY, STREAM_NZ, // unit normal
+        STREAM_D,                        // dot(n, a)
+        STREAM_E0X, STREAM_E0Y, STREAM_E0Z, // b - a
+        STREAM_E1X, STREAM_E1Y, STREAM_E1Z, // c - b
+        STREAM_E2X, STREAM_E2Y, STREAM_E2Z, // a - c
+        STREAM_MINX, STREAM_MINY, STREAM_MINZ,
+        STREAM_MAXX, STREAM_MAXY, STREAM_MAXZ,
+        STREAM_COUNT
+    };
+
+    // triangles baked for collision in SoA form, everything the tests need is precomputed
+    // so the loops over many triangles are only loads and multiply adds. the streams are
+    // padded to a multiple of 8 with triangles that can not be hit
+    class CollisionMesh
+    {
+    public:
+        CollisionMesh() : mCount(0), mStride(0) {}
+
+        void Build(const Triangle* triangles, int count);
+
+        int Count() const { return mCount; }
+        const float* Stream(int stream) const { return mData.data() + stream * mStride; }
+
+        Triangle GetTriangle(int i) const;
+        Plane GetPlane(int i) const;
+        Vector3 GetNormal(int i) const;
+        // p has to be on the plane of the triangle
+        bool PointInTriangle(int i, const Vector3& p) const;
+        // same result as Ray::RaycastTriangle
+        real RaycastTriangle(int i, const Ray& ray) const;
+
+        // closest hit of the ray against the triangles in [first, first + count), Moller-Trumbore
+        // on 8 (AVX) or 4 (SSE) triangles at a time. back faces are ignored like in Ray::RaycastTriangle.
+        // return the t in [0, tMax] of the closest hit or -1
+        real RaycastBatch(int first, int count, const Ray& ray, real tMax, int& triangle) const;
+        // several rays against the same triangles, 8 or 4 rays at a time. tHit has the tMax of each
+        // ray and get the t of its closest hit (unchanged if nothing is hit), triangles get the hit triangle or -1
+        void RaycastPacket(int first, int count, const Ray* rays, int rayCount, real* tHit, int* triangles) const;
+
+        // write to candidates the triangles in [first, first + count) that a sphere moving from c to c + movement
+        // can touch: the bounds overlap the swept box and the sphere reach the plane. return how many
+        int CullSweptSphere(int first, int count, const Vector3& c, const Vector3& movement, real r, int* candidates) const;
+
+    private:
+        real RaycastMT(int i, const Ray& ray) const;
+
+        std::vector<float> mData;
+        int mCount;
+        int mStride;
+    };
+
+}}
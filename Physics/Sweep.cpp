@@ -0,0 +1,397 @@
+#include "Sweep.h"
+
+#include <float.h>
+
+namespace Ruby { namespace Physics {
+
+    // first t in [0, 1] where o + d * t is at distance r of the point
+    static bool SegmentSphere(const Vector3& o, const Vector3& d, const Vector3& center, real r, real& t)
+    {
+        Vector3 m = o - center;
+        real a = d.ScalarProduct(d);
+        real b = m.ScalarProduct(d);
+        real c = m.ScalarProduct(m) - r * r;
+        if (c <= 0.0f)
+        {
+            t = 0.0f;
+            return true;
+        }
+        if (b >= 0.0f || a <= FLT_EPSILON) return false;
+        real discr = b * b - a * c;
+        if (discr < 0.0f) return false;
+        t = (-b - real_sqrt(discr)) / a;
+        return t <= 1.0f;
+    }
+
+    // first t in [0, 1] where o + d * t is at distance r of the segment p q
+    static bool SegmentCapsule(const Vector3& o, const Vector3& d, const Vector3& p, const Vector3& q, real r, real& tOut)
+    {
+        bool result = false;
+        tOut = 1.0f;
+
+        // the side of the capsule, an infinite cylinder limited to the segment
+        Vector3 e = q - p;
+        Vector3 m = o - p;
+        real ee = e.ScalarProduct(e);
+        real md = m.ScalarProduct(e);
+        real nd = d.ScalarProduct(e);
+        real a = d.ScalarProduct(d) * ee - nd * nd;
+        real b = ee * m.ScalarProduct(d) - nd * md;
+        real c = ee * (m.ScalarProduct(m) - r * r) - md * md;
+        if (fabsf(a) > FLT_EPSILON)
+        {
+            real discr = b * b - a * c;
+            if (discr >= 0.0f)
+            {
+                real t = (-b - real_sqrt(discr)) / a;
+                if (c <= 0.0f) t = 0.0f;
+                real s = md + t * nd;
+                if (t >= 0.0f && t <= 1.0f && s >= 0.0f && s <= ee)
+                {
+                    tOut = t;
+                    result = true;
+                }
+            }
+        }
+
+        // the caps
+        real t;
+        if (SegmentSphere(o, d, p, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        if (SegmentSphere(o, d, q, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        return result;
+    }
+
+    // first t in [0, 1] where the segment a b moved by d * t is at distance r of the segment p q.
+    // the d * t that touch are the parallelogram p - a + (q - p) * s + (a - b) * w grown by r,
+    // its flat sides are tested here and its edges are the ends of each segment against the other
+    static bool SegmentSegment(const Vector3& a, const Vector3& b, const Vector3& d,
+                               const Vector3& p, const Vector3& q, real r, real& tOut)
+    {
+        bool result = false;
+        tOut = 1.0f;
+
+        Vector3 u = q - p;
+        Vector3 v = a - b;
+        Vector3 corner = p - a;
+        Vector3 n = u.VectorProduct(v);
+        real uu = u.ScalarProduct(u);
+        real vv = v.ScalarProduct(v);
+        // parallel segments have no flat side, only the edges
+        if (n.SquareMagnitude() > FLT_EPSILON * uu * vv)
+        {
+            n.Normalize();
+            // distance of the start to the parallelogram plane, on the side of the start
+            real dist = -n.ScalarProduct(corner);
+            real speed = n.ScalarProduct(d);
+            if (dist < 0.0f)
+            {
+                dist = -dist;
+                speed = -speed;
+            }
+            real t = -1.0f;
+            if (dist <= r) t = 0.0f;
+            else if (speed < 0.0f) t = (r - dist) / speed;
+            if (t >= 0.0f && t <= 1.0f)
+            {
+                // the point where the plane is touch in the parallelogram coordinates
+                Vector3 x = d * t - corner;
+                real uv = u.ScalarProduct(v);
+                real xu = x.ScalarProduct(u);
+                real xv = x.ScalarProduct(v);
+                real denom = uu * vv - uv * uv;
+                real s = (xu * vv - xv * uv) / denom;
+                real w = (xv * uu - xu * uv) / denom;
+                if (s >= 0.0f && s <= 1.0f && w >= 0.0f && w <= 1.0f)
+                {
+                    tOut = t;
+                    result = true;
+                }
+            }
+        }
+
+        real t;
+        Vector3 back = d * -1.0f;
+        if (SegmentCapsule(a, d, p, q, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        if (SegmentCapsule(b, d, p, q, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        if (SegmentCapsule(p, back, a, b, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        if (SegmentCapsule(q, back, a, b, r, t) && t <= tOut)
+        {
+            tOut = t;
+            result = true;
+        }
+        return result;
+    }
+
+    static Vector3 ClosestPointSegment(const Vector3& p, const Vector3& a, const Vector3& b)
+    {
+        Vector3 ab = b - a;
+        real denom = ab.ScalarProduct(ab);
+        if (denom <= FLT_EPSILON) return a;
+        real t = (p - a).ScalarProduct(ab) / denom;
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+        return a + ab * t;
+    }
+
+    static void SetHit(SweepHit& hit, real t, const Vector3& point, Vector3 normal, const CollisionMesh* mesh, int triangle)
+    {
+        normal.Normalize();
+        hit.t = t;
+        hit.point = point;
+        hit.normal = normal;
+        hit.plane.n = normal;
+        hit.plane.d = normal.ScalarProduct(point);
+        hit.mesh = mesh;
+        hit.triangle = triangle;
+    }
+
+    // normal of the triangle on the side of the point
+    static Vector3 FaceNormal(const CollisionMesh* mesh, int i, const Vector3& point)
+    {
+        Plane plane = mesh->GetPlane(i);
+        return plane.n.ScalarProduct(point) - plane.d >= 0.0f ? plane.n : plane.n * -1.0f;
+    }
+
+    // the sphere against the inside of the triangle
+    static bool SweepSphereFace(const Sphere& sphere, const Vector3& movement,
+                                const CollisionMesh* mesh, int i, real tMax, SweepHit& hit)
+    {
+        Plane plane = mesh->GetPlane(i);
+        real dist = plane.n.ScalarProduct(sphere.c) - plane.d;
+        Vector3 n = dist >= 0.0f ? plane.n : plane.n * -1.0f;
+
+        // moving away from the plane, only the face. the edges can still be hit
+        if (n.ScalarProduct(movement) >= 0.0f) return false;
+
+        Sphere s = sphere;
+        float t = -1.0f;
+        Vector3 q;
+        if (s.MovingSpherePlane(movement, plane, t, q) && t >= 0.0f && t <= tMax)
+        {
+            Vector3 center = sphere.c + movement * t;
+            Vector3 point = center - n * (n.ScalarProduct(center) - (dist >= 0.0f ? plane.d : -plane.d));
+            if (mesh->PointInTriangle(i, point))
+            {
+                SetHit(hit, t, point, n, mesh, i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the sphere against one triangle, first the face and then the edges
+    static bool SweepSphereTriangle(const Sphere& sphere, const Vector3& movement,
+                                    const CollisionMesh* mesh, int i, real tMax, SweepHit& hit)
+    {
+        if (SweepSphereFace(sphere, movement, mesh, i, tMax, hit)) return true;
+
+        bool result = false;
+        Triangle triangle = mesh->GetTriangle(i);
+        Vector3 vertices[3] = { triangle.a, triangle.b, triangle.c };
+        for (int j = 0; j < 3; ++j)
+        {
+            real edgeT;
+            const Vector3& a = vertices[j];
+            const Vector3& b = vertices[(j + 1) % 3];
+            if (SegmentCapsule(sphere.c, movement, a, b, sphere.r, edgeT) && edgeT <= tMax)
+            {
+                Vector3 center = sphere.c + movement * edgeT;
+                Vector3 point = ClosestPointSegment(center, a, b);
+                Vector3 normal = center - point;
+                if (normal.SquareMagnitude() <= FLT_EPSILON) normal = FaceNormal(mesh, i, sphere.c);
+                // moving away from the edge
+                if (normal.ScalarProduct(movement) >= 0.0f) continue;
+                SetHit(hit, edgeT, point, normal, mesh, i);
+                tMax = edgeT;
+                result = true;
+            }
+        }
+        return result;
+    }
+
+    bool SweepSphere(const Sphere& sphere, const Vector3& movement,
+                     const TriangleRange* ranges, int rangeCount, SweepHit& hit)
+    {
+        bool result = false;
+        real tMax = 1.0f;
+        for (int range = 0; range < rangeCount; ++range)
+        {
+            const CollisionMesh* mesh = ranges[range].mesh;
+            int end = ranges[range].first + ranges[range].count;
+            for (int chunk = ranges[range].first; chunk < end; chunk += RUBY_COLLISION_CHUNK)
+            {
+                int candidates[RUBY_COLLISION_CHUNK];
+                int chunkCount = end - chunk < RUBY_COLLISION_CHUNK ? end - chunk : RUBY_COLLISION_CHUNK;
+                int candidateCount = mesh->CullSweptSphere(chunk, chunkCount, sphere.c, movement, sphere.r, candidates);
+                for (int i = 0; i < candidateCount; ++i)
+                {
+                    if (SweepSphereTriangle(sphere, movement, mesh, candidates[i], tMax, hit))
+                    {
+                        tMax = hit.t;
+                        result = true;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    bool SweepCapsule(const Capsule& capsule, const Vector3& movement,
+                      const TriangleRange* ranges, int rangeCount, SweepHit& hit)
+    {
+        // the contacts of a capsule without radius have no normal to slide on
+        if (capsule.r <= 0.0f) return false;
+
+        bool result = false;
+        real tMax = 1.0f;
+        Sphere ends[2];
+        ends[0].c = capsule.a;
+        ends[0].r = capsule.r;
+        ends[1].c = capsule.b;
+        ends[1].r = capsule.r;
+
+        Vector3 boxMin = Vector3(fminf(capsule.a.x, capsule.b.x), fminf(capsule.a.y, capsule.b.y), fminf(capsule.a.z, capsule.b.z));
+        Vector3 boxMax = Vector3(fmaxf(capsule.a.x, capsule.b.x), fmaxf(capsule.a.y, capsule.b.y), fmaxf(capsule.a.z, capsule.b.z));
+        Vector3 center = (boxMin + boxMax) * 0.5f;
+        real radius = (boxMax - boxMin).Magnitude() * 0.5f + capsule.r;
+        for (int range = 0; range < rangeCount; ++range)
+        {
+            const CollisionMesh* mesh = ranges[range].mesh;
+            int end = ranges[range].first + ranges[range].count;
+            for (int chunk = ranges[range].first; chunk < end; chunk += RUBY_COLLISION_CHUNK)
+            {
+                int candidates[RUBY_COLLISION_CHUNK];
+                int chunkCount = end - chunk < RUBY_COLLISION_CHUNK ? end - chunk : RUBY_COLLISION_CHUNK;
+                int candidateCount = mesh->CullSweptSphere(chunk, chunkCount, center, movement, radius, candidates);
+                for (int i = 0; i < candidateCount; ++i)
+                {
+                    int index = candidates[i];
+
+                    // the inside of the face is first touch by the end closer to its plane
+                    for (int j = 0; j < 2; ++j)
+                    {
+                        if (SweepSphereFace(ends[j], movement, mesh, index, tMax, hit))
+                        {
+                            tMax = hit.t;
+                            result = true;
+                        }
+                    }
+
+                    // the edges against the axis, the normal goes from the closest point of the edge to the axis
+                    Triangle triangle = mesh->GetTriangle(index);
+                    Vector3 vertices[3] = { triangle.a, triangle.b, triangle.c };
+                    for (int j = 0; j < 3; ++j)
+                    {
+                        real t;
+                        const Vector3& a = vertices[j];
+                        const Vector3& b = vertices[(j + 1) % 3];
+                        if (SegmentSegment(capsule.a, capsule.b, movement, a, b, capsule.r, t) && t <= tMax)
+                        {
+                            Vector3 offset = movement * t;
+                            real s, w;
+                            Vector3 axisPoint, edgePoint;
+                            ClosestPtSegmentSegment(capsule.a + offset, capsule.b + offset, a, b, s, w, axisPoint, edgePoint);
+                            Vector3 normal = axisPoint - edgePoint;
+                            if (normal.SquareMagnitude() <= FLT_EPSILON) normal = FaceNormal(mesh, index, axisPoint - offset);
+                            // moving away from the edge
+                            if (normal.ScalarProduct(movement) >= 0.0f) continue;
+                            SetHit(hit, t, edgePoint, normal, mesh, index);
+                            tMax = t;
+                            result = true;
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    int SlideSphere(Vector3& position, Vector3& velocity, real radius, real dt,
+                    const TriangleRange* ranges, int rangeCount)
+    {
+        int hitCount = 0;
+        for (int iteration = 0; iteration < RUBY_SWEEP_MAX_ITERATIONS; ++iteration)
+        {
+            if (velocity.SquareMagnitude() <= FLT_EPSILON) break;
+
+            Vector3 movement = velocity * dt;
+            Sphere sphere;
+            sphere.c = position;
+            sphere.r = radius;
+            SweepHit hit;
+            if (SweepSphere(sphere, movement, ranges, rangeCount, hit))
+            {
+                // move to the contact, keep a small gap and remove the velocity into the plane
+                position = position + movement * hit.t + hit.normal * RUBY_SWEEP_SKIN;
+                velocity = velocity - hit.normal * velocity.ScalarProduct(hit.normal);
+                dt = dt * (1.0f - hit.t);
+                ++hitCount;
+            }
+            else
+            {
+                position = position + movement;
+                break;
+            }
+        }
+        return hitCount;
+    }
+
+    int SlideCapsule(Capsule& capsule, Vector3& velocity, real dt,
+                     const TriangleRange* ranges, int rangeCount)
+    {
+        int hitCount = 0;
+        for (int iteration = 0; iteration < RUBY_SWEEP_MAX_ITERATIONS; ++iteration)
+        {
+            if (velocity.SquareMagnitude() <= FLT_EPSILON) break;
+
+            Vector3 movement = velocity * dt;
+            SweepHit hit;
+            if (SweepCapsule(capsule, movement, ranges, rangeCount, hit))
+            {
+                Vector3 offset = movement * hit.t + hit.normal * RUBY_SWEEP_SKIN;
+                capsule.a = capsule.a + offset;
+                capsule.b = capsule.b + offset;
+                velocity = velocity - hit.normal * velocity.ScalarProduct(hit.normal);
+                dt = dt * (1.0f - hit.t);
+                ++hitCount;
+            }
+            else
+            {
+                capsule.a = capsule.a + movement;
+                capsule.b = capsule.b + movement;
+                break;
+            }
+        }
+        return hitCount;
+    }
+
+    void SlideSpheres(SweepBody* bodies, int count, real dt)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            SweepBody& body = bodies[i];
+            body.hitCount = SlideSphere(body.position, body.velocity, body.radius, dt, body.ranges, body.rangeCount);
+        }
+    }
+
+}}
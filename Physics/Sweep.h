@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Collision.h"
+#include "CollisionMesh.h"
+
+#define RUBY_SWEEP_MAX_ITERATIONS 8
+#define RUBY_SWEEP_SKIN 0.005f
+
+namespace Ruby { namespace Physics {
+
+    // continuous collision of moving spheres and capsules against triangle ranges. nothing here
+    // allocate, all the scratch memory is on the stack so many bodies can be step in parallel
+
+    struct SweepHit
+    {
+        real t;         // time of impact, from 0 to 1 along the movement
+        Vector3 point;  // contact point on the triangle
+        Vector3 normal; // contact normal, point to the moving shape
+        Plane plane;    // slide plane, the normal through the contact point
+        const CollisionMesh* mesh;
+        int triangle;
+    };
+
+    // shape moving from its position to its position + movement, hit get the first contact
+    bool SweepSphere(const Sphere& sphere, const Vector3& movement,
+                     const TriangleRange* ranges, int rangeCount, SweepHit& hit);
+    bool SweepCapsule(const Capsule& capsule, const Vector3& movement,
+                      const TriangleRange* ranges, int rangeCount, SweepHit& hit);
+
+    // move position by velocity * dt and slide along the surfaces hit on the way,
+    // velocity lose the part that goes into them. return the number of hits
+    int SlideSphere(Vector3& position, Vector3& velocity, real radius, real dt,
+                    const TriangleRange* ranges, int rangeCount);
+    // same for a capsule, both ends move together
+    int SlideCapsule(Capsule& capsule, Vector3& velocity, real dt,
+                     const TriangleRange* ranges, int rangeCount);
+
+    struct SweepBody
+    {
+        Vector3 position;
+        Vector3 velocity;
+        real radius;
+        const TriangleRange* ranges;
+        int rangeCount;
+        int hitCount; // hits of the last step
+    };
+
+    void SlideSpheres(SweepBody* bodies, int count, real dt);
+
+}}
@@ -0,0 +1,319 @@
+#include "TriangleBVH.h"
+
+#include <float.h>
+#include <algorithm>
+
+#define RUBY_BVH_BIN_COUNT 12
+
+namespace Ruby { namespace Physics {
+
+    struct BuildTriangle
+    {
+        float min[3];
+        float max[3];
+        float centroid[3];
+    };
+
+    struct BuildBounds
+    {
+        float min[3];
+        float max[3];
+
+        void Reset()
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                min[i] = FLT_MAX;
+                max[i] = -FLT_MAX;
+            }
+        }
+
+        void Grow(const float* pmin, const float* pmax)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                if (pmin[i] < min[i]) min[i] = pmin[i];
+                if (pmax[i] > max[i]) max[i] = pmax[i];
+            }
+        }
+
+        float Area() const
+        {
+            float x = max[0] - min[0];
+            float y = max[1] - min[1];
+            float z = max[2] - min[2];
+            if (x < 0.0f || y < 0.0f || z < 0.0f) return 0.0f;
+            return 2.0f * (x * y + y * z + z * x);
+        }
+    };
+
+    static int BuildNode(std::vector<BVHNode>& nodes, std::vector<BuildTriangle>& build,
+                         std::vector<int>& order, int first, int count, int depth)
+    {
+        int index = (int)nodes.size();
+        nodes.push_back(BVHNode{});
+
+        BuildBounds bounds;
+        BuildBounds centroidBounds;
+        bounds.Reset();
+        centroidBounds.Reset();
+        for (int i = first; i < first + count; ++i)
+        {
+            BuildTriangle& t = build[order[i]];
+            bounds.Grow(t.min, t.max);
+            centroidBounds.Grow(t.centroid, t.centroid);
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            nodes[index].min[i] = bounds.min[i];
+            nodes[index].max[i] = bounds.max[i];
+        }
+
+        // find the best split with binned SAH
+        int bestAxis = -1;
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+        if (count > 2 && depth < RUBY_BVH_MAX_DEPTH)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if (extent <= 0.0f) continue;
+
+                BuildBounds binBounds[RUBY_BVH_BIN_COUNT];
+                int binCount[RUBY_BVH_BIN_COUNT] = {};
+                for (int i = 0; i < RUBY_BVH_BIN_COUNT; ++i) binBounds[i].Reset();
+
+                float scale = RUBY_BVH_BIN_COUNT / extent;
+                for (int i = first; i < first + count; ++i)
+                {
+                    BuildTriangle& t = build[order[i]];
+                    int bin = (int)((t.centroid[axis] - centroidBounds.min[axis]) * scale);
+                    if (bin >= RUBY_BVH_BIN_COUNT) bin = RUBY_BVH_BIN_COUNT - 1;
+                    ++binCount[bin];
+                    binBounds[bin].Grow(t.min, t.max);
+                }
+
+                // sweep from the right to get the cost of every plane in one pass
+                float rightArea[RUBY_BVH_BIN_COUNT];
+                int rightCount[RUBY_BVH_BIN_COUNT];
+                BuildBounds right;
+                right.Reset();
+                int rightSum = 0;
+                for (int i = RUBY_BVH_BIN_COUNT - 1; i > 0; --i)
+                {
+                    right.Grow(binBounds[i].min, binBounds[i].max);
+                    rightSum += binCount[i];
+                    rightArea[i] = right.Area();
+                    rightCount[i] = rightSum;
+                }
+
+                BuildBounds left;
+                left.Reset();
+                int leftSum = 0;
+                for (int i = 0; i < RUBY_BVH_BIN_COUNT - 1; ++i)
+                {
+                    left.Grow(binBounds[i].min, binBounds[i].max);
+                    leftSum += binCount[i];
+                    if (leftSum == 0 || rightCount[i + 1] == 0) continue;
+                    float cost = left.Area() * leftSum + rightArea[i + 1] * rightCount[i + 1];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = i;
+                    }
+                }
+            }
+        }
+
+        // make a leaf when splitting is not cheaper than testing all the triangles
+        float leafCost = bounds.Area() * count;
+        if (bestAxis == -1 || (bestCost >= leafCost && count <= RUBY_BVH_MAX_LEAF_TRIANGLES))
+        {
+            nodes[index].index = first;
+            nodes[index].count = count;
+            return index;
+        }
+
+        float scale = RUBY_BVH_BIN_COUNT / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        float minCentroid = centroidBounds.min[bestAxis];
+        int* middle = std::partition(order.data() + first, order.data() + first + count, [&](int triangle)
+        {
+            int bin = (int)((build[triangle].centroid[bestAxis] - minCentroid) * scale);
+            if (bin >= RUBY_BVH_BIN_COUNT) bin = RUBY_BVH_BIN_COUNT - 1;
+            return bin <= bestBin;
+        });
+        int leftCount = (int)(middle - (order.data() + first));
+
+        BuildNode(nodes, build, order, first, leftCount, depth + 1);
+        int rightChild = BuildNode(nodes, build, order, first + leftCount, count - leftCount, depth + 1);
+        nodes[index].index = rightChild;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    void TriangleBVH::Build(std::vector<Triangle>& triangles)
+    {
+        mNodes.clear();
+        if (triangles.empty()) return;
+
+        std::vector<BuildTriangle> build(triangles.size());
+        std::vector<int> order(triangles.size());
+        for (int i = 0; i < triangles.size(); ++i)
+        {
+            Triangle& t = triangles[i];
+            BuildTriangle& b = build[i];
+            b.min[0] = fminf(t.a.x, fminf(t.b.x, t.c.x));
+            b.min[1] = fminf(t.a.y, fminf(t.b.y, t.c.y));
+            b.min[2] = fminf(t.a.z, fminf(t.b.z, t.c.z));
+            b.max[0] = fmaxf(t.a.x, fmaxf(t.b.x, t.c.x));
+            b.max[1] = fmaxf(t.a.y, fmaxf(t.b.y, t.c.y));
+            b.max[2] = fmaxf(t.a.z, fmaxf(t.b.z, t.c.z));
+            for (int j = 0; j < 3; ++j)
+            {
+                b.centroid[j] = (b.min[j] + b.max[j]) * 0.5f;
+            }
+            order[i] = i;
+        }
+
+        mNodes.reserve(triangles.size() * 2);
+        BuildNode(mNodes, build, order, 0, (int)triangles.size(), 0);
+
+        std::vector<Triangle> sorted(triangles.size());
+        for (int i = 0; i < order.size(); ++i)
+        {
+            sorted[i] = triangles[order[i]];
+        }
+        triangles.swap(sorted);
+    }
+
+    void TriangleBVH::QueryBox(const CollisionMesh* mesh, const Vector3& c, const Vector3& r, std::vector<TriangleRange>& result) const
+    {
+        auto overlap = [&c, &r](const BVHNode& node)
+        {
+            if (c.x + r.x < node.min[0] || c.x - r.x > node.max[0]) return false;
+            if (c.y + r.y < node.min[1] || c.y - r.y > node.max[1]) return false;
+            if (c.z + r.z < node.min[2] || c.z - r.z > node.max[2]) return false;
+            return true;
+        };
+        Query(mesh, overlap, result);
+    }
+
+    void TriangleBVH::QuerySphere(const CollisionMesh* mesh, const Sphere& sphere, std::vector<TriangleRange>& result) const
+    {
+        auto overlap = [&sphere](const BVHNode& node)
+        {
+            // squared distance from the center to the box
+            float c[3] = { sphere.c.x, sphere.c.y, sphere.c.z };
+            float sqDist = 0.0f;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (c[i] < node.min[i]) sqDist += (node.min[i] - c[i]) * (node.min[i] - c[i]);
+                if (c[i] > node.max[i]) sqDist += (c[i] - node.max[i]) * (c[i] - node.max[i]);
+            }
+            return sqDist <= sphere.r * sphere.r;
+        };
+        Query(mesh, overlap, result);
+    }
+
+    // slab test of the segment o + d * t, t from 0 to tMax, against the node grow by radius
+    static bool SegmentNode(const BVHNode& node, const float* o, const float* d, float radius, float tMax, float& tEnter)
+    {
+        float tMin = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            float min = node.min[i] - radius;
+            float max = node.max[i] + radius;
+            if (fabsf(d[i]) < FLT_EPSILON)
+            {
+                if (o[i] < min || o[i] > max) return false;
+            }
+            else
+            {
+                float inv = 1.0f / d[i];
+                float t0 = (min - o[i]) * inv;
+                float t1 = (max - o[i]) * inv;
+                if (t0 > t1) { float temp = t0; t0 = t1; t1 = temp; }
+                if (t0 > tMin) tMin = t0;
+                if (t1 < tMax) tMax = t1;
+                if (tMin > tMax) return false;
+            }
+        }
+        tEnter = tMin;
+        return true;
+    }
+
+    void TriangleBVH::QueryCapsule(const CollisionMesh* mesh, const Capsule& capsule, std::vector<TriangleRange>& result) const
+    {
+        float o[3] = { capsule.a.x, capsule.a.y, capsule.a.z };
+        float d[3] = { capsule.b.x - capsule.a.x, capsule.b.y - capsule.a.y, capsule.b.z - capsule.a.z };
+        auto overlap = [&o, &d, &capsule](const BVHNode& node)
+        {
+            // the segment against the node grow by the radius, a bit conservative at the corners
+            float tEnter;
+            return SegmentNode(node, o, d, capsule.r, 1.0f, tEnter);
+        };
+        Query(mesh, overlap, result);
+    }
+
+    real TriangleBVH::Raycast(const CollisionMesh* mesh, Ray& ray, real tMax, int& triangle) const
+    {
+        real result = -1.0f;
+        if (mNodes.empty()) return result;
+
+        float o[3] = { ray.o.x, ray.o.y, ray.o.z };
+        float d[3] = { ray.d.x, ray.d.y, ray.d.z };
+
+        float tEnter;
+        if (!SegmentNode(mNodes[0], o, d, 0.0f, tMax, tEnter)) return result;
+
+        int stack[RUBY_BVH_MAX_DEPTH + 1];
+        float stackEnter[RUBY_BVH_MAX_DEPTH + 1];
+        int top = 0;
+        stack[top] = 0;
+        stackEnter[top++] = tEnter;
+        while (top > 0)
+        {
+            --top;
+            if (stackEnter[top] > tMax) continue;
+            int index = stack[top];
+            const BVHNode& node = mNodes[index];
+
+            if (node.count > 0)
+            {
+                real t = mesh->RaycastBatch(node.index, node.count, ray, tMax, triangle);
+                if (t >= 0.0f)
+                {
+                    tMax = t;
+                    result = t;
+                }
+            }
+            else
+            {
+                // push the far child first so the near one is visit first
+                int children[2] = { index + 1, node.index };
+                float enter[2];
+                bool hit[2];
+                for (int i = 0; i < 2; ++i)
+                {
+                    hit[i] = SegmentNode(mNodes[children[i]], o, d, 0.0f, tMax, enter[i]);
+                }
+                int nearChild = (hit[0] && hit[1] && enter[1] < enter[0]) ? 1 : 0;
+                int farChild = 1 - nearChild;
+                if (hit[farChild])
+                {
+                    stack[top] = children[farChild];
+                    stackEnter[top++] = enter[farChild];
+                }
+                if (hit[nearChild])
+                {
+                    stack[top] = children[nearChild];
+                    stackEnter[top++] = enter[nearChild];
+                }
+            }
+        }
+        return result;
+    }
+
+}}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "Collision.h"
+#include "CollisionMesh.h"
+
+#define RUBY_BVH_MAX_LEAF_TRIANGLES 4
+#define RUBY_BVH_MAX_DEPTH 48
+
+namespace Ruby { namespace Physics {
+
+    // 32 bytes, the nodes are store depth first so the left child of an inner node is
+    // always the next node and only the right child index is saved
+    struct BVHNode
+    {
+        float min[3];
+        int index; // first triangle for the leaves, right child for the inner nodes
+        float max[3];
+        int count; // triangles in the leaf, 0 for the inner nodes
+    };
+
+    class TriangleBVH
+    {
+    public:
+        // SAH build, the triangles are reorder so the triangles of a leaf are contiguous
+        void Build(std::vector<Triangle>& triangles);
+
+        // append the triangles of the leaves that overlap the shape to result, mesh has
+        // to be build from the triangles after the BVH sorted them
+        void QueryBox(const CollisionMesh* mesh, const Vector3& c, const Vector3& r, std::vector<TriangleRange>& result) const;
+        void QuerySphere(const CollisionMesh* mesh, const Sphere& sphere, std::vector<TriangleRange>& result) const;
+        void QueryCapsule(const CollisionMesh* mesh, const Capsule& capsule, std::vector<TriangleRange>& result) const;
+
+        // closest hit of o + d * t with t from 0 to tMax, return -1 when nothing is hit
+        real Raycast(const CollisionMesh* mesh, Ray& ray, real tMax, int& triangle) const;
+
+        bool Empty() const { return mNodes.empty(); }
+
+        std::vector<BVHNode> mNodes;
+    private:
+        template<typename Overlap>
+        void Query(const CollisionMesh* mesh, Overlap& overlap, std::vector<TriangleRange>& result) const;
+    };
+
+    template<typename Overlap>
+    void TriangleBVH::Query(const CollisionMesh* mesh, Overlap& overlap, std::vector<TriangleRange>& result) const
+    {
+        if (mNodes.empty()) return;
+
+        int stack[RUBY_BVH_MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode& node = mNodes[stack[--top]];
+            if (!overlap(node)) continue;
+
+            if (node.count > 0)
+            {
+                // leaves next to each other in memory are merge in one range
+                TriangleRange* last = result.empty() ? nullptr : &result.back();
+                if (last && last->mesh == mesh && last->first + last->count == node.index)
+                {
+                    last->count += node.count;
+                }
+                else
+                {
+                    TriangleRange range = { mesh, node.index, node.count };
+                    result.push_back(range);
+                }
+            }
+            else
+            {
+                int current = (int)(&node - mNodes.data());
+                stack[top++] = node.index;
+                stack[top++] = current + 1;
+            }
+        }
+    }
+
+}}
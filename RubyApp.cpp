@@ -1,6 +1,8 @@
 #include "RubyApp.h"
+#include "RubyDebugProfiler.h"
 
 #include <WindowsX.h>
+#include <stdio.h>
 
 namespace Ruby
 {
@@ -31,13 +33,24 @@ namespace Ruby
         mSwapChain(nullptr),
         mDepthStencilBuffer(nullptr),
         mRenderTargetView(nullptr),
-        mDepthStencilView(nullptr)
+        mDepthStencilView(nullptr),
+        mJobs(nullptr),
+        mThreadCount(JobSystem::GetDefaultThreadCount()),
+        mPipelined(false),
+        mSimulationState(0),
+        mRenderState(0),
+        mRenderStateReady(false),
+        mAccumulator(0.0f)
     {
         ZeroMemory(&mViewport, sizeof(D3D11_VIEWPORT));
         gRubyApp = this;
     }
     App::~App()
     {
+        SAFE_DELETE(mJobs);
+        // after the workers are join, they dont use the profiler anymore
+        DebugProfiler::Shutdown();
+
         SAFE_RELEASE(mRenderTargetView);
         SAFE_RELEASE(mDepthStencilView);
         SAFE_RELEASE(mSwapChain);
@@ -50,6 +63,19 @@ namespace Ruby
         SAFE_RELEASE(mDevice);
     }
 
+    void App::SetThreadCount(UINT32 threadCount)
+    {
+        mThreadCount = threadCount > 0 ? threadCount : 1;
+    }
+
+    void App::SetPipelined(bool pipelined)
+    {
+        mPipelined = pipelined;
+        mSimulationState = pipelined ? 1 : 0;
+        mRenderState = 0;
+        mRenderStateReady = false;
+    }
+
     HINSTANCE App::Instance()
     {
         return mInstance;
@@ -166,60 +192,84 @@ namespace Ruby
     {
 
         mTimer.Reset();
+        mFrameStats.Reset();
 
         mRunning = true;
 
-        float accumulator = 0.0f;
+        mAccumulator = 0.0f;
         float dt = 1.0f / 120.0f;
         float targetFrameTime = 1.0f/120.0f;
 
-        LARGE_INTEGER freq;
-        LARGE_INTEGER lastTime;
-        QueryPerformanceFrequency(&freq);
-        QueryPerformanceCounter(&lastTime);
+        double secondsPerTick = 1.0 / (double)Clock::GetOSFrequency();
+        UINT64 lastTime = Clock::ReadOSTimer();
 
         while (mRunning)
         {
-            LARGE_INTEGER currentTime;
-            QueryPerformanceCounter(&currentTime);
+            UINT64 currentTime = Clock::ReadOSTimer();
 
-            float frameTime = (float)(currentTime.QuadPart - lastTime.QuadPart) / (float)freq.QuadPart;
+            float frameTime = (float)((double)(currentTime - lastTime) * secondsPerTick);
             while (frameTime < targetFrameTime)
             {
                 FlushEvents();
-                QueryPerformanceCounter(&currentTime);
-                frameTime = (float)(currentTime.QuadPart - lastTime.QuadPart) / (float)freq.QuadPart;
+                currentTime = Clock::ReadOSTimer();
+                frameTime = (float)((double)(currentTime - lastTime) * secondsPerTick);
             }
 
             lastTime = currentTime;
 
+            DebugProfilerBegin(Frame);
+
             FlushEvents();
 
+            // save the next frames of all the threads as a Chrome trace
+            if (mInput.KeyJustDown(VK_F11))
+            {
+                DebugProfiler::BeginCapture(RUBY_PROFILER_CAPTURE_FRAMES, RUBY_PROFILER_CAPTURE_PATH);
+            }
+            if (mInput.KeyJustDown(VK_F10))
+            {
+                mFrameStats.WriteCSV(RUBY_FRAME_STATS_CSV_PATH);
+            }
+
             mTimer.Tick();
 
             if (!mPause)
             {
+                // the tail of the frame times over the last frames, not only the last one
                 char buffer[256];
-                wsprintf(buffer, "%s FPS: %d\n", mWindowCaption, (int)(1.0f / mTimer.DeltaTime()));
+                sprintf_s(buffer, "%s FPS: %d, p50 %.2f ms, p99 %.2f ms", mWindowCaption, (int)(1.0f / mTimer.DeltaTime()),
+                          mFrameStats.GetPercentile(FRAME_STAT_FRAME_TIME, 0.5f),
+                          mFrameStats.GetPercentile(FRAME_STAT_FRAME_TIME, 0.99f));
                 SetWindowText(mWindow, buffer);
+                mFrameStats.Set(FRAME_STAT_FRAME_TIME, mTimer.DeltaTime() * 1000.0f);
 
                 // Update
+                UINT64 updateStart = Clock::ReadOSTimer();
                 UpdateScene();
+                mFrameStats.Set(FRAME_STAT_UPDATE, (float)(Clock::OSTicksToSeconds(Clock::ReadOSTimer() - updateStart) * 1000.0));
 
-                // Fix Update
-                accumulator += mTimer.DeltaTime();
-                int counter = 0;
-                while (accumulator >= dt) {
-                    counter++;
-                    
-                    FixUpdateScene(dt);
-                    accumulator -= dt;
+                if (mPipelined)
+                {
+                    // simulate the next frame in a worker while this thread draw the last one,
+                    // the frame take max(simulation, render) instead of the sum. the first frame
+                    // has nothing to draw yet. it is a long job so the waits of the draw dont run it
+                    JobCounter simulation;
+                    App* app = this;
+                    mJobs->RunLong([app, dt]() { app->Simulate(dt); }, &simulation);
+                    if (mRenderStateReady) TimedDrawScene();
+                    mJobs->Wait(&simulation);
+
+                    mRenderState = mSimulationState;
+                    mSimulationState = 1 - mSimulationState;
+                    mRenderStateReady = true;
+                }
+                else
+                {
+                    Simulate(dt);
+                    TimedDrawScene();
                 }
 
-                float t = accumulator / dt;
-                PostUpdateScene(t); // NOTE: this is use for position interpolation before rendering
-
-                DrawScene();
+                mFrameStats.EndFrame();
             }
             else
             {
@@ -228,13 +278,53 @@ namespace Ruby
 
             mInput.mLast = mInput.mCurrent;
 
+            DebugProfilerEnd(Frame);
+
+            // empty the profiler rings of all the threads every frame so they dont drop events
+            DebugProfiler::EndFrame();
+
         }
         return 0;
     }
 
 
+    void App::Simulate(float dt)
+    {
+        DebugProfilerBegin(Simulate);
+        UINT64 start = Clock::ReadOSTimer();
+
+        // Fix Update
+        mAccumulator += mTimer.DeltaTime();
+        int counter = 0;
+        while (mAccumulator >= dt) {
+            counter++;
+            FixUpdateScene(dt);
+            mAccumulator -= dt;
+        }
+
+        float t = mAccumulator / dt;
+        PostUpdateScene(t); // NOTE: this is use for position interpolation before rendering
+
+        // this can run in a worker, the main thread dont touch these two stats
+        mFrameStats.Set(FRAME_STAT_FIXED_STEPS, (float)counter);
+        mFrameStats.Set(FRAME_STAT_SIMULATE, (float)(Clock::OSTicksToSeconds(Clock::ReadOSTimer() - start) * 1000.0));
+        DebugProfilerEnd(Simulate);
+    }
+
+    void App::TimedDrawScene()
+    {
+        DebugProfilerBegin(DrawScene);
+        UINT64 start = Clock::ReadOSTimer();
+        DrawScene();
+        mFrameStats.Set(FRAME_STAT_DRAW, (float)(Clock::OSTicksToSeconds(Clock::ReadOSTimer() - start) * 1000.0));
+        DebugProfilerEnd(DrawScene);
+    }
+
     bool App::Init()
     {
+        DebugProfiler::SetThreadName("Main");
+        mJobs = new JobSystem(mThreadCount);
+
         if (!InitMainWindow())
             return false;
 
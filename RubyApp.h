@@ -9,6 +9,8 @@
 #include "RubyDefines.h"
 #include "RubyTimer.h"
 #include "RubyInput.h"
+#include "RubyJobSystem.h"
+#include "RubyFrameStats.h"
 #include "GeometryGenerator.h"
 
 using namespace DirectX;
@@ -27,6 +29,13 @@ namespace Ruby
         float AspectRatio();
         int Run();
         void FlushEvents();
+        // threads of the job system, call it before Init. the default is one per hardware thread
+        void SetThreadCount(UINT32 threadCount);
+        // pipelined frames: the fixed updates and PostUpdateScene of the next frame run in a job
+        // while DrawScene draw the current one. PostUpdateScene write what DrawScene need into the
+        // render state mSimulationState and DrawScene only read mRenderState, neither of them can
+        // touch the state of the other. UpdateScene still run in the main thread before the job
+        void SetPipelined(bool pipelined);
 
         // framework methods. derived client class overrides this methos
         // to implement specifics application requirements
@@ -50,6 +59,10 @@ namespace Ruby
     protected:
         bool InitMainWindow();
         bool InitDirect3D();
+        // the fixed updates of the time since the last frame and the PostUpdateScene
+        void Simulate(float dt);
+        // DrawScene with the profiler and the frame stats
+        void TimedDrawScene();
 
     protected:
         HINSTANCE mInstance;
@@ -63,6 +76,19 @@ namespace Ruby
 
         Timer mTimer;
         Input mInput;
+        // timings and counters of the last frames, F10 write them to RUBY_FRAME_STATS_CSV_PATH
+        FrameStats mFrameStats;
+        // shared by all the CPU heavy work: loading, splitting, physics
+        JobSystem* mJobs;
+        UINT32 mThreadCount;
+
+        bool mPipelined;
+        // index of the render state the simulation write and of the one DrawScene read,
+        // they are the same one unless the frames are pipelined
+        UINT32 mSimulationState;
+        UINT32 mRenderState;
+        bool mRenderStateReady;
+        float mAccumulator;
 
         ID3D11DeviceContext* mImmediateContext; // this is for single threading, try the deferred contex for multithreading
         IDXGISwapChain* mSwapChain;
@@ -91,145 +91,16 @@ namespace Ruby
         return result;
     }
 
-    void CollisionDetection(XMVECTOR pos, XMVECTOR vel, float dt,
-        Physics::Triangle* triangles, int count, 
-        float& outT, unsigned& collisionCount, XMVECTOR& n)
-    {
-        collisionCount = 0;
-        Ruby::Physics::real smallesT = REAL_MAX;
-
-        XMVECTOR diff = vel * dt;
-
-        Physics::Vector3 movement = Ruby::Physics::Vector3(diff.m128_f32[0], diff.m128_f32[1], diff.m128_f32[2]);
-
-        Physics::Sphere sphere;
-        sphere.c = Ruby::Physics::Vector3(pos.m128_f32[0], pos.m128_f32[1], pos.m128_f32[2]);
-        sphere.r = 0.75f;
-
-        Physics::Segment segment;
-        segment.a = Ruby::Physics::Vector3(pos.m128_f32[0], pos.m128_f32[1], pos.m128_f32[2]);
-        segment.b = segment.a + Ruby::Physics::Vector3(diff.m128_f32[0], diff.m128_f32[1], diff.m128_f32[2]);
-
-        // Collision Detection
-        // TODO: see if all the t values are in the same range
-        for (int i = 0; i < count; ++i)
-        {
-            Ruby::Physics::Triangle triangle = triangles[i];
-
-            float t = -1.0f;
-            Physics::Point q;
-            sphere.MovingSpherePlane(movement, triangle.GetPlane(), t, q);
-
-            if (t >= 0.0f && t <= 1.0f)
-            {
-                if (q.InTriangle(triangle))
-                {
-                    if (t <= smallesT)
-                    {
-                        smallesT = t;
-                        Ruby::Physics::Vector3 normal = (triangle.b - triangle.a).VectorProduct(triangle.c - triangle.a);
-                        normal.Normalize();
-                        n = XMVectorSet(normal.x, normal.y, normal.z, 0.0);
-                        ++collisionCount;
-                    }   
-                }
-                else
-                {
-                    Physics::Capsule capsule[3];
-                    capsule[0].a = triangle.a;
-                    capsule[0].b = triangle.b;
-                    capsule[0].r = sphere.r - 0.05f;
-                    Physics::Capsule capsule1;
-                    capsule[1].a = triangle.b;
-                    capsule[1].b = triangle.c;
-                    capsule[1].r = sphere.r - 0.05f;
-                    Physics::Capsule capsule2;
-                    capsule[2].a = triangle.c;
-                    capsule[2].b = triangle.a;
-                    capsule[2].r = sphere.r - 0.05f;
-
-                    for (int i = 0; i < 3; ++i)
-                    {
-                        if (segment.IntersectCapsule(capsule[i], t, q))
-                        {
-                            if (t < smallesT)
-                            {
-                                Physics::Segment segment;
-                                segment.a = capsule[i].a;
-                                segment.b = capsule[i].b;
-                                smallesT = t;
-                                Ruby::Physics::Vector3 normal = q - q.ClosestPointSegement(segment);
-                                normal.Normalize();
-                                n = XMVectorSet(normal.x, normal.y, normal.z, 0.0);
-                                ++collisionCount;
-                            }
-                        }
-                    }
-
-                }
-            }
-
-        }
-        outT = smallesT;
-    }
-
-    void ProccessCollisionDetectionAndResolution(XMVECTOR& pos, XMVECTOR&potPos, XMVECTOR vel, float dt,
-        Physics::Triangle* triangles, int count)
-    {
-        Ruby::Physics::real t = REAL_MAX;
-        XMVECTOR n = XMVectorSet(0, 0, 0, 0);
-
-        unsigned int collisionCount = 0;
-        CollisionDetection(pos, vel, dt, triangles, count, t, collisionCount, n);
-
-        unsigned int iterations = 0;
-#if 1
-        while (XMVector3LengthSq(vel).m128_f32[0] > FLT_EPSILON)
-        {
-            if (collisionCount)
-            {
-                n = XMVector3Normalize(n);
-                pos = (pos + ((vel * dt) * t)) + (n * 0.005f);
-                vel = vel - (n * XMVector3Dot(vel, n));
-                dt = dt * (1.0f - t);
-                CollisionDetection(pos, vel, dt, triangles, count, t, collisionCount, n);
-            }
-            else
-            {
-                pos = pos + (vel * dt);
-                break;
-            }
-            ++iterations;
-        }
-#else
-        while (collisionCount && iterations < 20)
-        {
-            if (iterations == 0)
-            {
-                int StopHere = 0;
-            }
-
-            n = XMVector3Normalize(n);
-            pos = (pos + ((vel * dt) * t)) + (n * 0.005f);
-            vel = vel - (n * XMVector3Dot(vel, n));
-            XMVECTOR scaleVelocity = vel * (1.0f - t);
-            potPos = pos + scaleVelocity * dt;
-            ++iterations;
-            CollisionDetection(pos, vel, dt, triangles, count, t, collisionCount, n);
-        }
-#endif        
-    }
-
     void GroundDetection(Physics::Ray& ray,
         bool& grounded, XMFLOAT3& vel, XMFLOAT3& acc,
-        Physics::Triangle* triangles, int count)
+        const Physics::TriangleRange* ranges, int rangeCount)
     {
         grounded = false;
-        for (int i = 0; i < count; ++i)
+        for (int range = 0; range < rangeCount; ++range)
         {
-            Physics::Triangle triangle = triangles[i];
-            Physics::real t = ray.RaycastTriangle(triangle);
-            if (t >= 0.0f && t <= 1.0f)
+            int triangle;
+            Physics::real t = ranges[range].mesh->RaycastBatch(ranges[range].first, ranges[range].count, ray, 1.0f, triangle);
+            if (t >= 0.0f)
             {
                 grounded = true;
                 if (vel.y < 0)
@@ -237,7 +108,7 @@ namespace Ruby
                     vel.y = 0;
                     acc.y = 0;
                 }
-                break;
+                return;
             }
         }
     }
@@ -264,7 +135,7 @@ namespace Ruby
     
     }
 
-    void FPSCamera::FixUpdate(float dt, Ruby::Physics::Triangle* triangles, int count)
+    void FPSCamera::FixUpdate(float dt, const Ruby::Physics::TriangleRange* ranges, int rangeCount)
     {
         mLastPosition = mPosition;
         
@@ -287,20 +158,21 @@ namespace Ruby
             vel.m128_f32[2] = vel.m128_f32[2] * dammping;
         }
 
-        XMVECTOR potPos;
-        potPos = pos + (vel * dt);
-
         Physics::Ray ray;
         ray.o = Physics::Vector3(mPosition.x, mPosition.y, mPosition.z);
         ray.d = Physics::Vector3(0, -1, 0) * (0.75f + 0.15);
 
         XMStoreFloat3(&mVelocity, vel);
 
-        GroundDetection(ray, mGrounded, mVelocity, mAcceleration, triangles, count);
+        GroundDetection(ray, mGrounded, mVelocity, mAcceleration, ranges, rangeCount);
         
         vel = XMVectorSet(mVelocity.x, mVelocity.y, mVelocity.z, 0.0f);
 
-        ProccessCollisionDetectionAndResolution(pos, potPos, vel, dt, triangles, count);
+        // the slide change only the position, the velocity of the player is kept
+        Physics::Vector3 position = Physics::Vector3(pos.m128_f32[0], pos.m128_f32[1], pos.m128_f32[2]);
+        Physics::Vector3 slideVelocity = Physics::Vector3(mVelocity.x, mVelocity.y, mVelocity.z);
+        Physics::SlideSphere(position, slideVelocity, 0.75f, dt, ranges, rangeCount);
+        pos = XMVectorSet(position.x, position.y, position.z, 1.0f);
         
         XMStoreFloat3(&mVelocity, vel);
         XMStoreFloat3(&mPotentialPosition, pos);
@@ -3,6 +3,8 @@
 #include <DirectXMath.h>
 
 #include "Physics/Collision.h"
+#include "Physics/CollisionMesh.h"
+#include "Physics/Sweep.h"
 
 using namespace DirectX;
 
@@ -52,7 +54,7 @@ namespace Ruby
         bool Grounded();
 
         void Update(float dt);
-        void FixUpdate(float dt, Ruby::Physics::Triangle* triangles, int count);
+        void FixUpdate(float dt, const Ruby::Physics::TriangleRange* ranges, int rangeCount);
         void PostUpdate(float t);
         void MouseMove(float mouseX, float mouseY, float dt);
         void MoveForward();
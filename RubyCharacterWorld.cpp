@@ -0,0 +1,130 @@
+#include "RubyCharacterWorld.h"
+
+#include <math.h>
+
+namespace Ruby
+{
+    UINT32 CharacterWorld::AddCharacter(XMFLOAT3 position, float radius, float halfHeight, float speed, float jumpSpeed)
+    {
+        Character character{};
+        character.mPosition = position;
+        character.mRadius = radius;
+        character.mHalfHeight = halfHeight;
+        character.mSpeed = speed;
+        character.mJumpSpeed = jumpSpeed;
+        mCharacters.push_back(character);
+        return (UINT32)mCharacters.size() - 1;
+    }
+
+    void CharacterWorld::Step(float dt, JobSystem* jobs)
+    {
+        mDt = dt;
+        UINT32 chunkCount = ((UINT32)mCharacters.size() + RUBY_CHARACTER_CHUNK - 1) / RUBY_CHARACTER_CHUNK;
+        if (mChunkRanges.size() < chunkCount) mChunkRanges.resize(chunkCount);
+
+        if (jobs == nullptr)
+        {
+            for (UINT32 i = 0; i < chunkCount; ++i)
+            {
+                StepChunk(i);
+            }
+            return;
+        }
+
+        CharacterWorld* world = this;
+        jobs->ParallelFor(0, chunkCount, 1, [world](UINT32 begin, UINT32 end)
+        {
+            for (UINT32 i = begin; i < end; ++i)
+            {
+                world->StepChunk(i);
+            }
+        });
+    }
+
+    void CharacterWorld::StepChunk(UINT32 chunk)
+    {
+        UINT32 first = chunk * RUBY_CHARACTER_CHUNK;
+        UINT32 last = first + RUBY_CHARACTER_CHUNK;
+        if (last > mCharacters.size()) last = (UINT32)mCharacters.size();
+        for (UINT32 i = first; i < last; ++i)
+        {
+            StepCharacter(mCharacters[i], mChunkRanges[chunk]);
+        }
+    }
+
+    void CharacterWorld::StepCharacter(Character& character, std::vector<Physics::TriangleRange>& ranges)
+    {
+        float dt = mDt;
+        XMFLOAT3& vel = character.mVelocity;
+
+        // same movement as the FPSCamera: the input push the character, a lot less in the air
+        XMFLOAT3 acc = XMFLOAT3(0.0f, -RUBY_CHARACTER_GRAVITY, 0.0f);
+        XMFLOAT3 movement = character.mMovement;
+        float movementSq = movement.x * movement.x + movement.z * movement.z;
+        if (movementSq > 0.0f)
+        {
+            float scale = character.mSpeed / sqrtf(movementSq);
+            if (!character.mGrounded) scale *= 0.1f;
+            acc.x += movement.x * scale;
+            acc.z += movement.z * scale;
+        }
+        vel.x += acc.x * dt;
+        vel.y += acc.y * dt;
+        vel.z += acc.z * dt;
+
+        float dammping = powf(character.mGrounded ? 0.001f : 0.5f, dt);
+        vel.x *= dammping;
+        vel.z *= dammping;
+
+        if (character.mJump && character.mGrounded) vel.y = character.mJumpSpeed;
+        character.mMovement = XMFLOAT3(0, 0, 0);
+        character.mJump = false;
+
+        // the triangles the capsule, the ground ray and the movement can reach this step
+        float speed = sqrtf(vel.x * vel.x + vel.y * vel.y + vel.z * vel.z);
+        float reach = character.mRadius + RUBY_CHARACTER_GROUND_PROBE + speed * dt + 0.1f;
+        XMFLOAT3 extent = XMFLOAT3(reach, character.mHalfHeight + reach, reach);
+        Physics::Vector3 c = Physics::Vector3(character.mPosition.x, character.mPosition.y, character.mPosition.z);
+        Physics::Vector3 r = Physics::Vector3(extent.x, extent.y, extent.z);
+
+        ranges.clear();
+        LinearOctree<SceneStaticObject>* level = mLevel;
+        auto collectTriangles = [level, &c, &r, &ranges](UINT32 leaf)
+        {
+            SceneStaticObject* objects = level->GetObjects(leaf);
+            UINT32 objectCount = level->GetObjectCount(leaf);
+            for (UINT32 i = 0; i < objectCount; ++i)
+            {
+                objects[i].mBVH.QueryBox(&objects[i].mCollision, c, r, ranges);
+            }
+        };
+        mLevel->Visit(character.mPosition, extent, collectTriangles);
+
+        // ground, from the center of the bottom cap
+        Physics::Ray ray;
+        ray.o = Physics::Vector3(c.x, c.y - character.mHalfHeight, c.z);
+        ray.d = Physics::Vector3(0, -1, 0) * (character.mRadius + RUBY_CHARACTER_GROUND_PROBE);
+        character.mGrounded = false;
+        for (int i = 0; i < ranges.size(); ++i)
+        {
+            int triangle;
+            if (ranges[i].mesh->RaycastBatch(ranges[i].first, ranges[i].count, ray, 1.0f, triangle) >= 0.0f)
+            {
+                character.mGrounded = true;
+                break;
+            }
+        }
+        if (character.mGrounded && vel.y < 0) vel.y = 0;
+
+        Physics::Capsule capsule;
+        capsule.a = Physics::Vector3(c.x, c.y - character.mHalfHeight, c.z);
+        capsule.b = Physics::Vector3(c.x, c.y + character.mHalfHeight, c.z);
+        capsule.r = character.mRadius;
+        Physics::Vector3 velocity = Physics::Vector3(vel.x, vel.y, vel.z);
+        character.mHitCount = Physics::SlideCapsule(capsule, velocity, dt, ranges.data(), (int)ranges.size());
+
+        Physics::Vector3 center = (capsule.a + capsule.b) * 0.5f;
+        character.mPosition = XMFLOAT3(center.x, center.y, center.z);
+        vel = XMFLOAT3(velocity.x, velocity.y, velocity.z);
+    }
+}
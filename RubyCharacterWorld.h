@@ -0,0 +1,63 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "RubyTypes.h"
+#include "RubyScene.h"
+#include "RubyJobSystem.h"
+
+using namespace DirectX;
+
+#define RUBY_CHARACTER_CHUNK 32
+#define RUBY_CHARACTER_GRAVITY 9.8f
+#define RUBY_CHARACTER_GROUND_PROBE 0.15f
+
+namespace Ruby
+{
+    // a capsule controller, the capsule is vertical and mPosition is its center
+    struct Character
+    {
+        XMFLOAT3 mPosition;
+        XMFLOAT3 mVelocity;
+        // input of the next step: direction on the xz plane and jump, reset after the step
+        XMFLOAT3 mMovement;
+        bool mJump;
+
+        float mRadius;
+        float mHalfHeight; // from the center to the center of the caps
+        float mSpeed;
+        float mJumpSpeed;
+
+        bool mGrounded;
+        int mHitCount; // surfaces hit in the last step
+    };
+
+    // many characters colliding against the static level. the characters are step in chunks
+    // of RUBY_CHARACTER_CHUNK as jobs, every character only read the level and
+    // write itself (they dont collide with each other) so the result is the same with any
+    // number of threads
+    class CharacterWorld
+    {
+    private:
+        LinearOctree<SceneStaticObject>* mLevel;
+        std::vector<Character> mCharacters;
+        // triangle ranges of each chunk, reused every step
+        std::vector<std::vector<Physics::TriangleRange>> mChunkRanges;
+        float mDt;
+
+        void StepCharacter(Character& character, std::vector<Physics::TriangleRange>& ranges);
+    public:
+        CharacterWorld(LinearOctree<SceneStaticObject>* level)
+            : mLevel(level), mDt(0.0f) {};
+        ~CharacterWorld() {};
+
+        UINT32 AddCharacter(XMFLOAT3 position, float radius, float halfHeight, float speed, float jumpSpeed);
+        Character& GetCharacter(UINT32 id) { return mCharacters[id]; }
+        UINT32 GetCharacterCount() { return (UINT32)mCharacters.size(); }
+
+        // step every character, jobs can be nullptr to do all the work in this thread
+        void Step(float dt, JobSystem* jobs);
+        void StepChunk(UINT32 chunk);
+    };
+}
@@ -0,0 +1,77 @@
+#include "RubyClock.h"
+
+#if defined(_WIN32)
+#include <intrin.h>
+#else
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace Ruby
+{
+    static UINT64 QueryOSFrequency()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        return freq.QuadPart;
+#else
+        return 1000000000ull;
+#endif
+    }
+
+    static UINT64 CalibrateCPUFrequency()
+    {
+        UINT64 osFreq = Clock::GetOSFrequency();
+        UINT64 osWaitTime = osFreq * RUBY_CLOCK_CALIBRATION_MS / 1000;
+
+        UINT64 cpuStart = Clock::ReadCPUTimer();
+        UINT64 osStart = Clock::ReadOSTimer();
+        UINT64 osElapsed = 0;
+        while (osElapsed < osWaitTime)
+        {
+            osElapsed = Clock::ReadOSTimer() - osStart;
+        }
+        UINT64 cpuElapsed = Clock::ReadCPUTimer() - cpuStart;
+
+        return (UINT64)((double)osFreq * (double)cpuElapsed / (double)osElapsed);
+    }
+
+    UINT64 Clock::ReadOSTimer()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER value;
+        QueryPerformanceCounter(&value);
+        return value.QuadPart;
+#else
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (UINT64)time.tv_sec * 1000000000ull + (UINT64)time.tv_nsec;
+#endif
+    }
+
+    UINT64 Clock::GetOSFrequency()
+    {
+        // the frequency never change while the system is running
+        static UINT64 frequency = QueryOSFrequency();
+        return frequency;
+    }
+
+    UINT64 Clock::ReadCPUTimer()
+    {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        return __rdtsc();
+#else
+        return ReadOSTimer();
+#endif
+    }
+
+    UINT64 Clock::GetCPUFrequency()
+    {
+        // the static is initialize once even with many threads asking at the same time
+        static UINT64 frequency = CalibrateCPUFrequency();
+        return frequency;
+    }
+}
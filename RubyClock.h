@@ -0,0 +1,23 @@
+#pragma once
+
+#include "RubyTypes.h"
+
+// how long the cpu counter is measured against the OS clock, only once per run
+#define RUBY_CLOCK_CALIBRATION_MS 20
+
+namespace Ruby
+{
+    // the timers of the engine. the OS timer is QueryPerformanceCounter on windows and
+    // clock_gettime(CLOCK_MONOTONIC) in nanoseconds on linux, the CPU timer is rdtsc (the
+    // OS timer on cpus without it). the CPU frequency is measured the first time it is ask for
+    class Clock
+    {
+    public:
+        static UINT64 ReadOSTimer();
+        static UINT64 GetOSFrequency();
+        static UINT64 ReadCPUTimer();
+        static UINT64 GetCPUFrequency();
+
+        static double OSTicksToSeconds(UINT64 ticks) { return (double)ticks / (double)GetOSFrequency(); }
+    };
+}
@@ -1,85 +1,375 @@
 #include "RubyDebugProfiler.h"
+#include "RubyPlatform.h"
 
+#include <atomic>
+#include <mutex>
 #include <stdio.h>
+#include <string.h>
 
 namespace Ruby
 {
-    CounterData DebugProfiler::mData[MAX_DEBUG_COUNTER_COUNT];
-    UINT64 DebugProfiler::mCounterCount;
+    // an open scope while the events of a thread are collected
+    struct ProfilerScope
+    {
+        UINT32 mNode;
+        UINT32 mDepth;
+        UINT64 mStart;
+        UINT64 mChildTime;
+    };
+
+    // a scope saved for the capture
+    struct ProfilerCaptureScope
+    {
+        const char* mName;
+        UINT64 mStart;
+        UINT64 mDuration;
+    };
+
+    struct ProfilerThread
+    {
+        // written only by the owner thread, the ring is allocated by its first Begin
+        ProfilerEvent* mEvents;
+        std::atomic<UINT64> mWrite;
+        std::atomic<UINT64> mRead;
+        std::atomic<UINT64> mDropped;
+        UINT32 mDepth;
+
+        // only used by Collect
+        std::vector<ProfilerNode> mNodes;
+        std::vector<ProfilerScope> mScopes;
+        std::vector<ProfilerCaptureScope> mCapture;
+        char mName[64];
+    };
+
+    // the threads are added the first time they use the profiler and removed by Shutdown,
+    // the mutex is not in the Begin/End path
+    static std::mutex gProfilerMutex;
+    static std::vector<ProfilerThread*> gProfilerThreads;
+    static thread_local ProfilerThread* tProfilerThread = nullptr;
+
+    // the capture, also protected by the mutex
+    static bool gCapturing = false;
+    static UINT32 gCaptureFrameCount;
+    static UINT64 gCaptureStart;
+    static std::vector<UINT64> gCaptureFrames;
+    static char gCapturePath[RUBY_MAX_PATH];
+
+    static void ResetNodes(ProfilerThread* thread)
+    {
+        ProfilerNode root{};
+        root.mName = "thread";
+        root.mParent = RUBY_PROFILER_NO_NODE;
+        root.mFirstChild = RUBY_PROFILER_NO_NODE;
+        root.mNextSibling = RUBY_PROFILER_NO_NODE;
+        root.mMin = ~0ull;
+        thread->mNodes.clear();
+        thread->mNodes.push_back(root);
+        // the open scopes point to the old nodes, their ends are ignored
+        thread->mScopes.clear();
+    }
+
+    static ProfilerThread* GetProfilerThread()
+    {
+        if (tProfilerThread == nullptr)
+        {
+            ProfilerThread* thread = new ProfilerThread();
+            thread->mEvents = nullptr;
+            thread->mWrite.store(0);
+            thread->mRead.store(0);
+            thread->mDropped.store(0);
+            thread->mDepth = 0;
+            thread->mName[0] = '\0';
+            ResetNodes(thread);
+
+            std::lock_guard<std::mutex> lock(gProfilerMutex);
+            gProfilerThreads.push_back(thread);
+            tProfilerThread = thread;
+        }
+        return tProfilerThread;
+    }
+
+    static void AddEvent(ProfilerThread* thread, const char* name, UINT32 depth, UINT32 begin)
+    {
+        // Collect only read the ring once mWrite move, so the pointer is publish by the release below
+        if (thread->mEvents == nullptr) thread->mEvents = new ProfilerEvent[RUBY_PROFILER_RING_SIZE];
+        UINT64 write = thread->mWrite.load(std::memory_order_relaxed);
+        if (write - thread->mRead.load(std::memory_order_acquire) >= RUBY_PROFILER_RING_SIZE)
+        {
+            // Collect fix the nesting of the scopes that lost an event
+            thread->mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ProfilerEvent& event = thread->mEvents[write & (RUBY_PROFILER_RING_SIZE - 1)];
+        event.mName = name;
+        event.mTime = Clock::ReadOSTimer();
+        event.mDepth = depth;
+        event.mBegin = begin;
+        thread->mWrite.store(write + 1, std::memory_order_release);
+    }
 
     void DebugProfiler::Begin(const char* name)
     {
-        mId = mCounterCount++;
-        mData[mId].mName = name;
-        mData[mId].mStartOS = ReadOSTimer();
-        mData[mId].mStartCPU = ReadCPUTimer();
+        mName = name;
+        ProfilerThread* thread = GetProfilerThread();
+        AddEvent(thread, name, thread->mDepth++, 1);
     }
 
     void DebugProfiler::End()
     {
-        mData[mId].mElapsedOS = ReadOSTimer() - mData[mId].mStartOS;
-        mData[mId].mElapsedCPU = ReadCPUTimer() - mData[mId].mStartCPU;
+        ProfilerThread* thread = GetProfilerThread();
+        AddEvent(thread, mName, --thread->mDepth, 0);
+    }
+
+    static UINT32 FindChild(ProfilerThread* thread, UINT32 parent, const char* name)
+    {
+        std::vector<ProfilerNode>& nodes = thread->mNodes;
+        UINT32 last = RUBY_PROFILER_NO_NODE;
+        UINT32 child = nodes[parent].mFirstChild;
+        while (child != RUBY_PROFILER_NO_NODE)
+        {
+            // the same name can have many pointers, one per translation unit
+            if (nodes[child].mName == name || strcmp(nodes[child].mName, name) == 0) return child;
+            last = child;
+            child = nodes[child].mNextSibling;
+        }
+
+        // added at the end so the children print in the order they first run
+        ProfilerNode node{};
+        node.mName = name;
+        node.mParent = parent;
+        node.mFirstChild = RUBY_PROFILER_NO_NODE;
+        node.mNextSibling = RUBY_PROFILER_NO_NODE;
+        node.mMin = ~0ull;
+        nodes.push_back(node);
+        UINT32 index = (UINT32)nodes.size() - 1;
+        if (last == RUBY_PROFILER_NO_NODE) nodes[parent].mFirstChild = index;
+        else nodes[last].mNextSibling = index;
+        return index;
+    }
+
+    static void AddTime(ProfilerNode& node, UINT64 inclusive, UINT64 exclusive)
+    {
+        ++node.mCalls;
+        node.mInclusive += inclusive;
+        node.mExclusive += exclusive;
+        if (inclusive < node.mMin) node.mMin = inclusive;
+        if (inclusive > node.mMax) node.mMax = inclusive;
+    }
+
+    static void CollectThread(ProfilerThread* thread)
+    {
+        std::vector<ProfilerScope>& scopes = thread->mScopes;
+        UINT64 read = thread->mRead.load(std::memory_order_relaxed);
+        UINT64 write = thread->mWrite.load(std::memory_order_acquire);
+        for (; read < write; ++read)
+        {
+            ProfilerEvent& event = thread->mEvents[read & (RUBY_PROFILER_RING_SIZE - 1)];
+
+            // scopes deeper than the event lost their end, forget them
+            while (!scopes.empty() && scopes.back().mDepth > event.mDepth) scopes.pop_back();
+
+            if (event.mBegin)
+            {
+                if (!scopes.empty() && scopes.back().mDepth == event.mDepth) scopes.pop_back();
+                ProfilerScope scope;
+                scope.mNode = FindChild(thread, scopes.empty() ? 0 : scopes.back().mNode, event.mName);
+                scope.mDepth = event.mDepth;
+                scope.mStart = event.mTime;
+                scope.mChildTime = 0;
+                scopes.push_back(scope);
+            }
+            else if (!scopes.empty() && scopes.back().mDepth == event.mDepth)
+            {
+                ProfilerScope scope = scopes.back();
+                scopes.pop_back();
+                UINT64 inclusive = event.mTime - scope.mStart;
+                UINT64 exclusive = inclusive > scope.mChildTime ? inclusive - scope.mChildTime : 0;
+                AddTime(thread->mNodes[scope.mNode], inclusive, exclusive);
+                if (gCapturing && scope.mStart >= gCaptureStart)
+                {
+                    ProfilerCaptureScope capture;
+                    capture.mName = event.mName;
+                    capture.mStart = scope.mStart;
+                    capture.mDuration = inclusive;
+                    thread->mCapture.push_back(capture);
+                }
+                if (scopes.empty()) AddTime(thread->mNodes[0], inclusive, inclusive);
+                else scopes.back().mChildTime += inclusive;
+            }
+        }
+        thread->mRead.store(read, std::memory_order_release);
+    }
+
+    void DebugProfiler::Collect()
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
+        {
+            CollectThread(gProfilerThreads[i]);
+        }
+    }
+
+    static void PrintNode(std::vector<ProfilerNode>& nodes, UINT32 index, int depth, double msPerTick)
+    {
+        ProfilerNode& node = nodes[index];
+        if (node.mCalls > 0)
+        {
+            DebugPrint("%*s%s: calls %llu, total %.3f ms, self %.3f ms, avg %.3f ms, min %.3f ms, max %.3f ms\n",
+                       depth * 2, "", node.mName, (unsigned long long)node.mCalls,
+                       (double)node.mInclusive * msPerTick, (double)node.mExclusive * msPerTick,
+                       (double)node.mInclusive * msPerTick / (double)node.mCalls,
+                       (double)node.mMin * msPerTick, (double)node.mMax * msPerTick);
+        }
+        for (UINT32 child = node.mFirstChild; child != RUBY_PROFILER_NO_NODE; child = nodes[child].mNextSibling)
+        {
+            PrintNode(nodes, child, depth + 1, msPerTick);
+        }
     }
 
     void DebugProfiler::PrintData()
     {
-        double total = (double)mData[0].mElapsedOS;
+        Collect();
 
-        for (int i = 0; i < mCounterCount; ++i)
+        double msPerTick = 1000.0 / (double)Clock::GetOSFrequency();
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
         {
-            UINT64 percentage = (UINT64)(((double)mData[i].mElapsedOS / total) * 100.0);
-            double secondsElapsed = (double)mData[i].mElapsedOS / (double)GetOSFrequency();
-            char buffer[256];
-            sprintf_s(buffer, "Cycles Elapsed: %llu, (%llu), %f sec [%s]\n", mData[i].mElapsedCPU, percentage, secondsElapsed, mData[i].mName);
-            OutputDebugString(buffer);
+            ProfilerThread* thread = gProfilerThreads[i];
+            if (thread->mNodes[0].mCalls == 0) continue;
+
+            DebugPrint("Thread %d %s, %llu events dropped\n", i, thread->mName, (unsigned long long)thread->mDropped.load());
+            PrintNode(thread->mNodes, 0, 0, msPerTick);
         }
-        mCounterCount = 0;
     }
 
+    void DebugProfiler::Reset()
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
+        {
+            ResetNodes(gProfilerThreads[i]);
+            gProfilerThreads[i]->mDropped.store(0);
+        }
+    }
 
-    UINT64 DebugProfiler::GetOSFrequency()
+    static void WriteCaptureName(FILE* file, const char* name)
     {
-        LARGE_INTEGER freq;
-        QueryPerformanceFrequency(&freq);
-        return freq.QuadPart;
+        for (const char* c = name; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\') fputc('\\', file);
+            fputc(*c, file);
+        }
     }
 
-    UINT64 DebugProfiler::ReadOSTimer()
+    // the Chrome trace event format: one complete event ("X") per scope with the times in
+    // microseconds, the frames are global instant events ("i") so they cross all the threads
+    static void WriteCapture()
     {
-        LARGE_INTEGER value;
-        QueryPerformanceCounter(&value);
-        return value.QuadPart;
+        FILE* file = OpenFile(gCapturePath, "w");
+        if (file == nullptr)
+        {
+            DebugPrint("Profiler capture could not be written\n");
+            return;
+        }
+
+        double usPerTick = 1000000.0 / (double)Clock::GetOSFrequency();
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"RubyEngine\"}}");
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
+        {
+            ProfilerThread* thread = gProfilerThreads[i];
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"", i);
+            if (thread->mName[0]) WriteCaptureName(file, thread->mName);
+            else fprintf(file, "Thread %d", i);
+            fprintf(file, "\"}}");
+            fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"sort_index\":%d}}", i, i);
+
+            for (int j = 0; j < thread->mCapture.size(); ++j)
+            {
+                ProfilerCaptureScope& scope = thread->mCapture[j];
+                fprintf(file, ",\n{\"name\":\"");
+                WriteCaptureName(file, scope.mName);
+                fprintf(file, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", i,
+                        (double)(scope.mStart - gCaptureStart) * usPerTick, (double)scope.mDuration * usPerTick);
+            }
+        }
+        for (int i = 0; i < gCaptureFrames.size(); ++i)
+        {
+            fprintf(file, ",\n{\"name\":\"Frame %d\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}", i,
+                    (double)(gCaptureFrames[i] - gCaptureStart) * usPerTick);
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+
+        DebugPrint("Profiler capture written to %s\n", gCapturePath);
     }
 
-    UINT64 DebugProfiler::GetCPUFrequency()
+    void DebugProfiler::EndFrame()
     {
-        UINT64 millisecondsToWait = 100.0f;
+        Collect();
 
-        UINT64 osFreq = GetOSFrequency();
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        if (!gCapturing) return;
+        gCaptureFrames.push_back(Clock::ReadOSTimer());
+        if (gCaptureFrames.size() < gCaptureFrameCount) return;
 
-        UINT64 cpuStart = ReadCPUTimer();
-        UINT64 osStart = ReadOSTimer();
-        UINT64 osEnd = 0;
-        UINT64 osElapsed = 0;
-        UINT64 osWaitTime = osFreq * millisecondsToWait / 1000;
-        while (osElapsed < osWaitTime)
+        WriteCapture();
+        gCapturing = false;
+        gCaptureFrames.clear();
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
         {
-            osEnd = ReadOSTimer();
-            osElapsed = osEnd - osStart;
+            gProfilerThreads[i]->mCapture.clear();
         }
-        UINT64 cpuEnd = ReadCPUTimer();
-        UINT64 cpuElapsed = cpuEnd - cpuStart;
-        UINT64 cpuFreq = 0;
-        if (osElapsed)
+    }
+
+    void DebugProfiler::BeginCapture(UINT32 frameCount, const char* path)
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        // a capture already running keep going
+        if (gCapturing) return;
+        gCapturing = true;
+        gCaptureFrameCount = frameCount > 0 ? frameCount : 1;
+        gCaptureStart = Clock::ReadOSTimer();
+        CopyString(gCapturePath, sizeof(gCapturePath), path);
+    }
+
+    bool DebugProfiler::IsCapturing()
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        return gCapturing;
+    }
+
+    void DebugProfiler::SetThreadName(const char* name)
+    {
+        ProfilerThread* thread = GetProfilerThread();
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        CopyString(thread->mName, sizeof(thread->mName), name);
+    }
+
+    void DebugProfiler::Shutdown()
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        for (int i = 0; i < gProfilerThreads.size(); ++i)
         {
-            cpuFreq = osFreq * cpuElapsed / osElapsed;
+            delete[] gProfilerThreads[i]->mEvents;
+            delete gProfilerThreads[i];
         }
+        std::vector<ProfilerThread*>().swap(gProfilerThreads);
+        tProfilerThread = nullptr;
 
-        return cpuFreq;
+        gCapturing = false;
+        std::vector<UINT64>().swap(gCaptureFrames);
+    }
+
+    UINT32 DebugProfiler::GetThreadCount()
+    {
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        return (UINT32)gProfilerThreads.size();
     }
 
-    UINT64 DebugProfiler::ReadCPUTimer()
+    void DebugProfiler::GetNodes(UINT32 thread, std::vector<ProfilerNode>& nodes)
     {
-        return __rdtsc();
+        std::lock_guard<std::mutex> lock(gProfilerMutex);
+        nodes = gProfilerThreads[thread]->mNodes;
     }
 }
\ No newline at end of file
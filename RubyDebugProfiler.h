@@ -1,35 +1,72 @@
 #pragma once
 
-#include <windows.h>
+#include <vector>
 
-#define MAX_DEBUG_COUNTER_COUNT 256
+#include "RubyTypes.h"
+#include "RubyClock.h"
+
+// events a thread can keep until they are collected, the new ones are drop when it is full
+#define RUBY_PROFILER_RING_SIZE 65536
+#define RUBY_PROFILER_NO_NODE 0xFFFFFFFF
+// frames App::Run capture when F11 is press
+#define RUBY_PROFILER_CAPTURE_FRAMES 120
+#define RUBY_PROFILER_CAPTURE_PATH "profiler_capture.json"
 
 namespace Ruby
 {
-    struct CounterData
+    struct ProfilerEvent
+    {
+        const char* mName;
+        UINT64 mTime;
+        UINT32 mDepth;
+        UINT32 mBegin;
+    };
+
+    // a scope with the same name and the same parents, added over all the collected frames.
+    // the node 0 of every thread is the root, its time is the sum of the top scopes
+    struct ProfilerNode
     {
         const char* mName;
-        UINT64 mStartOS;
-        UINT64 mElapsedOS;
-        UINT64 mStartCPU;
-        UINT64 mElapsedCPU;
+        UINT32 mParent;
+        UINT32 mFirstChild;
+        UINT32 mNextSibling;
+        UINT64 mCalls;
+        UINT64 mInclusive; // Clock OS timer ticks
+        UINT64 mExclusive; // without the time of the children
+        UINT64 mMin;
+        UINT64 mMax;
     };
 
+    // Begin and End add an event to a lock-free ring of the calling thread (one writer, one reader),
+    // Collect read the rings of all the threads and build one tree per thread. the scopes can nest
+    // and any thread can use it, the jobs show up in the tree of the worker that run them
     class DebugProfiler
     {
     private:
-        UINT64 mId;
-        static CounterData mData[MAX_DEBUG_COUNTER_COUNT];
-        static UINT64 mCounterCount;
+        const char* mName;
     public:
         void Begin(const char* name);
         void End();
 
+        // move the events of every thread into the trees, call it once per frame so the rings dont fill
+        static void Collect();
+        // Collect and mark the end of a frame in the capture, the capture is written after its last frame
+        static void EndFrame();
+        // keep every scope of all the threads that start from now until frameCount frames end and write
+        // them to path as a Chrome trace event json (open it in chrome://tracing or ui.perfetto.dev)
+        static void BeginCapture(UINT32 frameCount, const char* path);
+        static bool IsCapturing();
+        // name of the calling thread in the prints and the captures
+        static void SetThreadName(const char* name);
+        // collect and print the tree of every thread, the trees are not reset
         static void PrintData();
-        static UINT64 GetOSFrequency();
-        static UINT64 ReadOSTimer();
-        static UINT64 GetCPUFrequency();
-        static UINT64 ReadCPUTimer();
+        static void Reset();
+        // free the rings and the trees of all the threads, the other threads that used the
+        // profiler must be finish. a thread that use it again after is added again
+        static void Shutdown();
+        // threads that used the profiler and a copy of the tree of one of them
+        static UINT32 GetThreadCount();
+        static void GetNodes(UINT32 thread, std::vector<ProfilerNode>& nodes);
 
     };
 
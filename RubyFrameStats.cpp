@@ -0,0 +1,252 @@
+#include "RubyFrameStats.h"
+#include "RubyPlatform.h"
+
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#if RUBY_FRAME_STATS_ALLOCATIONS
+
+static std::atomic<UINT64> gAllocationCount(0);
+
+// replace the global new and delete to count the allocations, the nothrow versions call
+// these ones. the array and sized versions are replaced too so the whole set match, also
+// when a sanitizer bring its own
+void* operator new(size_t size)
+{
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+// types with alignas bigger than the default (the jobs, the MPMC queue rings) use these
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    size_t align = (size_t)alignment;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+    // aligned_alloc want the size to be a multiple of the alignment
+    size_t alignedSize = size > 0 ? (size + align - 1) & ~(align - 1) : align;
+    void* memory = aligned_alloc(align, alignedSize);
+#endif
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+#endif
+
+namespace Ruby
+{
+    static const char* gFrameStatNames[FRAME_STAT_COUNT] =
+    {
+        "frame_ms",
+        "fixed_steps",
+        "update_ms",
+        "simulate_ms",
+        "draw_ms",
+        "draw_calls",
+        "triangles",
+        "allocations"
+    };
+
+    std::atomic<UINT32> FrameStats::mDrawCalls(0);
+    std::atomic<UINT32> FrameStats::mTriangles(0);
+
+    FrameStats::FrameStats()
+        : mFrameCount(0), mLastAllocationCount(0)
+    {
+        memset(mValues, 0, sizeof(mValues));
+        memset(mCurrent, 0, sizeof(mCurrent));
+    }
+
+    void FrameStats::EndFrame()
+    {
+        // the draws and allocations are counted all the time, the frame get what changed since the last one
+        UINT64 allocationCount = GetAllocationCount();
+        mCurrent[FRAME_STAT_ALLOCATIONS] += (float)(allocationCount - mLastAllocationCount);
+        mLastAllocationCount = allocationCount;
+        mCurrent[FRAME_STAT_DRAW_CALLS] += (float)mDrawCalls.exchange(0);
+        mCurrent[FRAME_STAT_TRIANGLES] += (float)mTriangles.exchange(0);
+
+        UINT32 index = (UINT32)(mFrameCount % RUBY_FRAME_STATS_SIZE);
+        for (int i = 0; i < FRAME_STAT_COUNT; ++i)
+        {
+            mValues[i][index] = mCurrent[i];
+            mCurrent[i] = 0.0f;
+        }
+        ++mFrameCount;
+    }
+
+    void FrameStats::Reset()
+    {
+        memset(mValues, 0, sizeof(mValues));
+        memset(mCurrent, 0, sizeof(mCurrent));
+        mFrameCount = 0;
+        mLastAllocationCount = GetAllocationCount();
+        mDrawCalls.store(0);
+        mTriangles.store(0);
+    }
+
+    UINT32 FrameStats::GetFrameCount()
+    {
+        return mFrameCount < RUBY_FRAME_STATS_SIZE ? (UINT32)mFrameCount : RUBY_FRAME_STATS_SIZE;
+    }
+
+    float FrameStats::GetValue(FrameStat stat, UINT32 framesAgo)
+    {
+        if (framesAgo >= GetFrameCount()) return 0.0f;
+        return mValues[stat][(mFrameCount - 1 - framesAgo) % RUBY_FRAME_STATS_SIZE];
+    }
+
+    float FrameStats::GetPercentile(FrameStat stat, float percentile)
+    {
+        UINT32 count = GetFrameCount();
+        if (count == 0) return 0.0f;
+
+        // only the order around the rank matters, nth_element is enough
+        memcpy(mScratch, mValues[stat], count * sizeof(float));
+        float rank = percentile * (float)(count - 1) + 0.5f;
+        UINT32 index = rank > 0.0f ? (UINT32)rank : 0;
+        if (index > count - 1) index = count - 1;
+        std::nth_element(mScratch, mScratch + index, mScratch + count);
+        return mScratch[index];
+    }
+
+    float FrameStats::GetAverage(FrameStat stat)
+    {
+        UINT32 count = GetFrameCount();
+        if (count == 0) return 0.0f;
+
+        double sum = 0.0;
+        for (UINT32 i = 0; i < count; ++i)
+        {
+            sum += mValues[stat][i];
+        }
+        return (float)(sum / (double)count);
+    }
+
+    void FrameStats::GetHistogram(FrameStat stat, float min, float max, UINT32* bins, UINT32 binCount)
+    {
+        if (binCount == 0) return;
+        memset(bins, 0, binCount * sizeof(UINT32));
+        UINT32 count = GetFrameCount();
+        float scale = max > min ? (float)binCount / (max - min) : 0.0f;
+        for (UINT32 i = 0; i < count; ++i)
+        {
+            float bin = (mValues[stat][i] - min) * scale;
+            UINT32 index = bin > 0.0f ? (UINT32)bin : 0;
+            if (index > binCount - 1) index = binCount - 1;
+            ++bins[index];
+        }
+    }
+
+    bool FrameStats::WriteCSV(const char* path)
+    {
+        FILE* file = OpenFile(path, "w");
+        if (file == nullptr) return false;
+
+        fprintf(file, "frame");
+        for (int i = 0; i < FRAME_STAT_COUNT; ++i)
+        {
+            fprintf(file, ",%s", gFrameStatNames[i]);
+        }
+        fprintf(file, "\n");
+
+        UINT32 count = GetFrameCount();
+        for (UINT32 j = count; j > 0; --j)
+        {
+            UINT64 frame = mFrameCount - j;
+            fprintf(file, "%llu", (unsigned long long)frame);
+            for (int i = 0; i < FRAME_STAT_COUNT; ++i)
+            {
+                fprintf(file, ",%g", mValues[i][frame % RUBY_FRAME_STATS_SIZE]);
+            }
+            fprintf(file, "\n");
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    const char* FrameStats::GetName(FrameStat stat)
+    {
+        return gFrameStatNames[stat];
+    }
+
+    void FrameStats::AddDraw(UINT32 triangles)
+    {
+        mDrawCalls.fetch_add(1, std::memory_order_relaxed);
+        mTriangles.fetch_add(triangles, std::memory_order_relaxed);
+    }
+
+    UINT64 FrameStats::GetAllocationCount()
+    {
+#if RUBY_FRAME_STATS_ALLOCATIONS
+        return gAllocationCount.load(std::memory_order_relaxed);
+#else
+        return 0;
+#endif
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include "RubyTypes.h"
+
+// frames kept by the stats, the percentiles and histograms are over these frames
+#define RUBY_FRAME_STATS_SIZE 1024
+// count the calls to the global operator new (aligned ones too), the count is a relaxed atomic add per allocation
+#define RUBY_FRAME_STATS_ALLOCATIONS 1
+#define RUBY_FRAME_STATS_CSV_PATH "frame_stats.csv"
+
+namespace Ruby
+{
+    enum FrameStat
+    {
+        FRAME_STAT_FRAME_TIME,  // ms
+        FRAME_STAT_FIXED_STEPS,
+        FRAME_STAT_UPDATE,      // ms in UpdateScene
+        FRAME_STAT_SIMULATE,    // ms in the fixed updates and PostUpdateScene
+        FRAME_STAT_DRAW,        // ms in DrawScene
+        FRAME_STAT_DRAW_CALLS,
+        FRAME_STAT_TRIANGLES,
+        FRAME_STAT_ALLOCATIONS,
+        FRAME_STAT_COUNT
+    };
+
+    // the last RUBY_FRAME_STATS_SIZE frames of every stat in ring buffers. the stats of the
+    // current frame are Set or Add during the frame and EndFrame move them to the rings.
+    // different stats can be set from different threads, the queries are for one thread only
+    class FrameStats
+    {
+    private:
+        float mValues[FRAME_STAT_COUNT][RUBY_FRAME_STATS_SIZE];
+        float mCurrent[FRAME_STAT_COUNT];
+        UINT64 mFrameCount;
+        UINT64 mLastAllocationCount;
+        // copy of a ring for the percentiles
+        float mScratch[RUBY_FRAME_STATS_SIZE];
+
+        // the draws can come from any thread, they are move into the frame in EndFrame
+        static std::atomic<UINT32> mDrawCalls;
+        static std::atomic<UINT32> mTriangles;
+    public:
+        FrameStats();
+
+        void Set(FrameStat stat, float value) { mCurrent[stat] = value; }
+        void Add(FrameStat stat, float value) { mCurrent[stat] += value; }
+        void EndFrame();
+        // forget the frames, the draws and allocations done until now are not counted
+        void Reset();
+
+        // frames in the rings and frames since the start
+        UINT32 GetFrameCount();
+        UINT64 GetTotalFrameCount() { return mFrameCount; }
+        // value of a previous frame, 0 is the last one
+        float GetValue(FrameStat stat, UINT32 framesAgo);
+        // percentile in [0, 1] (nearest rank), 0.99 is the p99
+        float GetPercentile(FrameStat stat, float percentile);
+        float GetAverage(FrameStat stat);
+        // binCount bins between min and max, the values outside go to the first and last bin
+        void GetHistogram(FrameStat stat, float min, float max, UINT32* bins, UINT32 binCount);
+        // one line per frame in the rings, the oldest first
+        bool WriteCSV(const char* path);
+
+        static const char* GetName(FrameStat stat);
+        // called by MeshGeometry::Draw
+        static void AddDraw(UINT32 triangles);
+        static UINT64 GetAllocationCount();
+    };
+}
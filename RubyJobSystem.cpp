@@ -0,0 +1,422 @@
+#include "RubyJobSystem.h"
+#include "RubyDebugProfiler.h"
+
+#include <stdio.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define RUBY_JOB_PAUSE() _mm_pause()
+#else
+#define RUBY_JOB_PAUSE() std::this_thread::yield()
+#endif
+
+namespace Ruby
+{
+    // the system and index of the current thread, only set in the threads of a system
+    static thread_local JobSystem* tJobSystem = nullptr;
+    static thread_local UINT32 tThreadIndex = RUBY_JOB_EXTERNAL_THREAD;
+    // how long this thread spin before sleeping, grow when spinning pay off
+    static thread_local UINT32 tSpinCount = RUBY_JOB_SPIN_MIN;
+    // waits this thread is inside of
+    static thread_local UINT32 tWaitDepth = 0;
+
+    UINT32 EventCount::PrepareWait()
+    {
+        mWaiterCount.fetch_add(1);
+        return mEpoch.load();
+    }
+
+    void EventCount::CancelWait()
+    {
+        mWaiterCount.fetch_sub(1);
+    }
+
+    void EventCount::Wait(UINT32 epoch)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mEpoch.load() == epoch)
+        {
+            mCondition.wait(lock);
+        }
+        mWaiterCount.fetch_sub(1);
+    }
+
+    void EventCount::NotifyOne()
+    {
+        // the waiter add itself before checking its condition, so if we dont see it
+        // it will see what we did before this call. that only hold when what we did and the
+        // waiter add and check are all seq_cst
+        if (mWaiterCount.load() == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEpoch.fetch_add(1);
+        }
+        mCondition.notify_one();
+    }
+
+    void EventCount::NotifyAll()
+    {
+        if (mWaiterCount.load() == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEpoch.fetch_add(1);
+        }
+        mCondition.notify_all();
+    }
+
+    JobDeque::JobDeque(INT64 size)
+        : mTop(0), mBottom(0)
+    {
+        JobArray* array = new JobArray();
+        array->mSize = size;
+        array->mJobs = new Job[size];
+        mArrays.push_back(array);
+        mArray.store(array);
+    }
+
+    JobDeque::~JobDeque()
+    {
+        for (int i = 0; i < mArrays.size(); ++i)
+        {
+            delete[] mArrays[i]->mJobs;
+            delete mArrays[i];
+        }
+    }
+
+    JobDeque::JobArray* JobDeque::Grow(JobArray* array, INT64 top, INT64 bottom)
+    {
+        JobArray* newArray = new JobArray();
+        newArray->mSize = array->mSize * 2;
+        newArray->mJobs = new Job[newArray->mSize];
+        for (INT64 i = top; i < bottom; ++i)
+        {
+            newArray->mJobs[i & (newArray->mSize - 1)] = array->mJobs[i & (array->mSize - 1)];
+        }
+        mArrays.push_back(newArray);
+        mArray.store(newArray, std::memory_order_release);
+        return newArray;
+    }
+
+    void JobDeque::Push(const Job& job)
+    {
+        INT64 bottom = mBottom.load(std::memory_order_relaxed);
+        INT64 top = mTop.load(std::memory_order_acquire);
+        JobArray* array = mArray.load(std::memory_order_relaxed);
+        if (bottom - top >= array->mSize) array = Grow(array, top, bottom);
+
+        array->mJobs[bottom & (array->mSize - 1)] = job;
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    bool JobDeque::Pop(Job& job)
+    {
+        INT64 bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 top = mTop.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            // empty
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        JobArray* array = mArray.load(std::memory_order_relaxed);
+        job = array->mJobs[bottom & (array->mSize - 1)];
+        if (top == bottom)
+        {
+            // last job, race with the thieves for it
+            bool won = mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool JobDeque::Steal(Job& job)
+    {
+        INT64 top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 bottom = mBottom.load(std::memory_order_acquire);
+        if (top >= bottom) return false;
+
+        // the copy is only valid if nobody else took the job before us
+        JobArray* array = mArray.load(std::memory_order_acquire);
+        job = array->mJobs[top & (array->mSize - 1)];
+        return mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    JobSystem::JobSystem(UINT32 threadCount)
+        : mExternalJobs(RUBY_JOB_DEQUE_SIZE), mLongJobs(RUBY_JOB_DEQUE_SIZE), mQueuedCount(0), mLongQueuedCount(0), mStoppedCount(0), mQuit(false)
+    {
+        if (threadCount < 1) threadCount = 1;
+        mThreadCount = threadCount;
+        for (UINT32 i = 0; i < threadCount; ++i)
+        {
+            mDeques.push_back(new JobDeque(RUBY_JOB_DEQUE_SIZE));
+        }
+
+        // the creating thread is the thread 0
+        tJobSystem = this;
+        tThreadIndex = 0;
+
+        for (UINT32 i = 1; i < threadCount; ++i)
+        {
+            mThreads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+        }
+    }
+
+    JobSystem::~JobSystem()
+    {
+        mQuit.store(true);
+        mEvent.NotifyAll();
+        for (int i = 0; i < mThreads.size(); ++i)
+        {
+            mThreads[i].join();
+        }
+        for (int i = 0; i < mDeques.size(); ++i)
+        {
+            delete mDeques[i];
+        }
+        if (tJobSystem == this)
+        {
+            tJobSystem = nullptr;
+            tThreadIndex = RUBY_JOB_EXTERNAL_THREAD;
+        }
+    }
+
+    UINT32 JobSystem::GetDefaultThreadCount()
+    {
+        UINT32 count = std::thread::hardware_concurrency();
+        return count > 0 ? count : 1;
+    }
+
+    UINT32 JobSystem::GetThreadIndex()
+    {
+        return tJobSystem == this ? tThreadIndex : RUBY_JOB_EXTERNAL_THREAD;
+    }
+
+    void JobSystem::Push(const Job& job)
+    {
+        UINT32 threadIndex = GetThreadIndex();
+        if (threadIndex != RUBY_JOB_EXTERNAL_THREAD)
+        {
+            mDeques[threadIndex]->Push(job);
+        }
+        else
+        {
+            mExternalJobs.Push(job);
+        }
+
+        mQueuedCount.fetch_add(1);
+        mEvent.NotifyOne();
+    }
+
+    void JobSystem::PushLong(Job& job)
+    {
+        // nobody else can run it
+        if (mThreadCount == 1)
+        {
+            Execute(job);
+            return;
+        }
+
+        mLongJobs.Push(job);
+        mLongQueuedCount.fetch_add(1);
+        // NotifyOne could wake a thread in Wait that cant take it
+        mEvent.NotifyAll();
+    }
+
+    bool JobSystem::FindJob(UINT32 threadIndex, bool longJobs, Job& job)
+    {
+        bool found = false;
+        // the long jobs first, the thread that added them is already waiting for them
+        if (longJobs && mLongQueuedCount.load(std::memory_order_relaxed) > 0 && mLongJobs.Pop(job))
+        {
+            mLongQueuedCount.fetch_sub(1);
+            return true;
+        }
+
+        if (threadIndex != RUBY_JOB_EXTERNAL_THREAD)
+        {
+            found = mDeques[threadIndex]->Pop(job);
+        }
+
+        if (!found)
+        {
+            found = mExternalJobs.Pop(job);
+        }
+
+        // steal from the other threads, starting at the next one so they dont all hit the same deque
+        UINT32 first = threadIndex != RUBY_JOB_EXTERNAL_THREAD ? threadIndex + 1 : 0;
+        for (UINT32 i = 0; i < mThreadCount && !found; ++i)
+        {
+            UINT32 victim = (first + i) % mThreadCount;
+            if (victim != threadIndex) found = mDeques[victim]->Steal(job);
+        }
+
+        if (found) mQueuedCount.fetch_sub(1);
+        return found;
+    }
+
+    bool JobSystem::Spin(UINT32 threadIndex, bool longJobs, JobCounter* counter, Job& job)
+    {
+        UINT32 spinCount = tSpinCount;
+        for (UINT32 i = 0; i < spinCount; ++i)
+        {
+            if (counter && counter->mCount.load(std::memory_order_acquire) == 0) return false;
+            // only touch the deques when there is something in them
+            bool queued = mQueuedCount.load(std::memory_order_relaxed) > 0 ||
+                          (longJobs && mLongQueuedCount.load(std::memory_order_relaxed) > 0);
+            if (queued && FindJob(threadIndex, longJobs, job))
+            {
+                tSpinCount = spinCount * 2 < RUBY_JOB_SPIN_MAX ? spinCount * 2 : RUBY_JOB_SPIN_MAX;
+                return true;
+            }
+            RUBY_JOB_PAUSE();
+        }
+        tSpinCount = spinCount / 2 > RUBY_JOB_SPIN_MIN ? spinCount / 2 : RUBY_JOB_SPIN_MIN;
+        return false;
+    }
+
+    void JobSystem::Execute(Job& job)
+    {
+        job.mFunction(&job);
+        // wake the threads sleeping in Wait when the last job of a counter finish. the decrement
+        // has to be seq_cst: the waiter add itself to mWaiterCount and then load the counter, we
+        // decrement and then load mWaiterCount, only a single total order make one of us see the other
+        if (job.mCounter && job.mCounter->mCount.fetch_sub(1, std::memory_order_seq_cst) == 1)
+        {
+            mEvent.NotifyAll();
+        }
+    }
+
+    void JobSystem::WorkerLoop(UINT32 threadIndex)
+    {
+        tJobSystem = this;
+        tThreadIndex = threadIndex;
+
+        char name[32];
+        snprintf(name, sizeof(name), "Worker %u", threadIndex);
+        DebugProfiler::SetThreadName(name);
+
+        while (!mQuit.load())
+        {
+            Job job;
+            if (FindJob(threadIndex, true, job) || Spin(threadIndex, true, nullptr, job))
+            {
+                Execute(job);
+                continue;
+            }
+
+            UINT32 epoch = mEvent.PrepareWait();
+            if (mQueuedCount.load() > 0 || mLongQueuedCount.load() > 0 || mQuit.load())
+            {
+                mEvent.CancelWait();
+                continue;
+            }
+            mEvent.Wait(epoch);
+        }
+    }
+
+    void JobSystem::Wait(JobCounter* counter)
+    {
+        UINT32 threadIndex = GetThreadIndex();
+        bool help = true;
+        if (threadIndex != RUBY_JOB_EXTERNAL_THREAD && tWaitDepth >= RUBY_JOB_MAX_WAIT_DEPTH)
+        {
+            // the add and the check are one operation so only one thread can be the last
+            help = mStoppedCount.fetch_add(1) == mThreadCount - 1;
+            if (help) mStoppedCount.fetch_sub(1);
+        }
+
+        ++tWaitDepth;
+        while (counter->mCount.load(std::memory_order_acquire) != 0)
+        {
+            // help with any job but the long ones, the last ones of the counter can be running in other threads
+            Job job;
+            if (help && (FindJob(threadIndex, false, job) || Spin(threadIndex, false, counter, job)))
+            {
+                Execute(job);
+                continue;
+            }
+
+            UINT32 epoch = mEvent.PrepareWait();
+            if (counter->mCount.load() == 0 || (help && mQueuedCount.load() > 0))
+            {
+                mEvent.CancelWait();
+                continue;
+            }
+            mEvent.Wait(epoch);
+        }
+        --tWaitDepth;
+
+        if (!help) mStoppedCount.fetch_sub(1);
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+        delete[] mPending;
+    }
+
+    UINT32 TaskGraph::AddTask(const char* name, std::function<void()> function)
+    {
+        Task task;
+        task.mName = name;
+        task.mFunction = function;
+        task.mDependencyCount = 0;
+        mTasks.push_back(task);
+        return (UINT32)mTasks.size() - 1;
+    }
+
+    void TaskGraph::AddDependency(UINT32 before, UINT32 after)
+    {
+        mTasks[before].mSuccessors.push_back(after);
+        ++mTasks[after].mDependencyCount;
+    }
+
+    void TaskGraph::RunTask(JobSystem* jobs, UINT32 task, JobCounter* counter)
+    {
+        TaskGraph* graph = this;
+        jobs->Run([graph, jobs, task, counter]()
+        {
+            Task& t = graph->mTasks[task];
+            DebugProfiler profiler;
+            profiler.Begin(t.mName);
+            t.mFunction();
+            profiler.End();
+            // the successors are added before this job finish, so the counter cant get to zero early
+            for (int i = 0; i < t.mSuccessors.size(); ++i)
+            {
+                UINT32 successor = t.mSuccessors[i];
+                if (graph->mPending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    graph->RunTask(jobs, successor, counter);
+                }
+            }
+        }, counter);
+    }
+
+    void TaskGraph::Run(JobSystem* jobs)
+    {
+        if (mPendingCount != mTasks.size())
+        {
+            delete[] mPending;
+            mPendingCount = (UINT32)mTasks.size();
+            mPending = new std::atomic<UINT32>[mPendingCount];
+        }
+        for (UINT32 i = 0; i < mPendingCount; ++i)
+        {
+            mPending[i].store(mTasks[i].mDependencyCount, std::memory_order_relaxed);
+        }
+
+        JobCounter counter;
+        for (UINT32 i = 0; i < mPendingCount; ++i)
+        {
+            if (mTasks[i].mDependencyCount == 0) RunTask(jobs, i, &counter);
+        }
+        jobs->Wait(&counter);
+    }
+}
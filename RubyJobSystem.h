@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "RubyTypes.h"
+#include "RubyMPMCQueue.h"
+
+// starting size of the deque of each thread and of the queue of the other threads, both grow when full
+#define RUBY_JOB_DEQUE_SIZE 1024
+// bytes for the closure of a job
+#define RUBY_JOB_DATA_SIZE 48
+#define RUBY_JOB_EXTERNAL_THREAD 0xFFFFFFFF
+// pause iterations an idle thread spin before it sleep, adapted per thread between the two
+#define RUBY_JOB_SPIN_MIN 64
+#define RUBY_JOB_SPIN_MAX 8192
+// nested waits a thread can have before it stop running other jobs inside Wait
+#define RUBY_JOB_MAX_WAIT_DEPTH 4
+
+namespace Ruby
+{
+    // count the jobs that are not finish yet, Wait on it to join them
+    struct JobCounter
+    {
+        std::atomic<UINT32> mCount;
+
+        JobCounter() : mCount(0) {};
+    };
+
+    // a closure copied inside the job, no allocation per job
+    struct alignas(64) Job
+    {
+        void (*mFunction)(Job* job);
+        JobCounter* mCounter;
+        alignas(16) UINT8 mData[RUBY_JOB_DATA_SIZE];
+    };
+
+    // sleep until something changes. the waiter call PrepareWait, check its condition again
+    // and then Wait or CancelWait, a Notify after PrepareWait is never lost. Notify is a single
+    // atomic load when nobody is waiting, the mutex is only used to sleep
+    class EventCount
+    {
+    private:
+        std::atomic<UINT32> mEpoch;
+        std::atomic<UINT32> mWaiterCount;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+    public:
+        EventCount() : mEpoch(0), mWaiterCount(0) {};
+
+        UINT32 PrepareWait();
+        void CancelWait();
+        void Wait(UINT32 epoch);
+        void NotifyOne();
+        void NotifyAll();
+    };
+
+    // Chase-Lev work stealing deque. the owner thread push and pop at the bottom,
+    // the other threads steal from the top. when it is full the owner copy the jobs to an
+    // array twice as big, the old arrays are kept until the deque is deleted because a
+    // thief can still be reading them
+    class JobDeque
+    {
+    private:
+        struct JobArray
+        {
+            INT64 mSize;
+            Job* mJobs;
+        };
+
+        std::atomic<INT64> mTop;
+        std::atomic<INT64> mBottom;
+        std::atomic<JobArray*> mArray;
+        std::vector<JobArray*> mArrays;
+
+        JobArray* Grow(JobArray* array, INT64 top, INT64 bottom);
+    public:
+        JobDeque(INT64 size);
+        ~JobDeque();
+
+        void Push(const Job& job);
+        bool Pop(Job& job);
+        bool Steal(Job& job);
+    };
+
+    class JobSystem
+    {
+    private:
+        UINT32 mThreadCount;
+        std::vector<std::thread> mThreads;
+        std::vector<JobDeque*> mDeques;
+
+        // jobs added by threads that are not part of the system
+        MPMCQueue<Job> mExternalJobs;
+        // jobs added with RunLong, only the workers take them
+        MPMCQueue<Job> mLongJobs;
+
+        // idle threads sleep here until there are jobs or a counter finish
+        EventCount mEvent;
+        std::atomic<INT32> mQueuedCount;
+        std::atomic<INT32> mLongQueuedCount;
+        // threads sleeping in a Wait past RUBY_JOB_MAX_WAIT_DEPTH without helping
+        std::atomic<UINT32> mStoppedCount;
+        std::atomic<bool> mQuit;
+
+        template<typename Function>
+        static void MakeJob(Job& job, Function function, JobCounter* counter);
+        void Push(const Job& job);
+        void PushLong(Job& job);
+        // longJobs is only true in the workers loop
+        bool FindJob(UINT32 threadIndex, bool longJobs, Job& job);
+        // spin a while before sleeping, stop when there is a job or the counter gets to zero
+        bool Spin(UINT32 threadIndex, bool longJobs, JobCounter* counter, Job& job);
+        void Execute(Job& job);
+        void WorkerLoop(UINT32 threadIndex);
+    public:
+        // threadCount include the calling thread, threadCount - 1 workers are created
+        JobSystem(UINT32 threadCount);
+        ~JobSystem();
+
+        // run function() in any thread, counter can be nullptr. the closure has to be trivially
+        // copyable and fit in RUBY_JOB_DATA_SIZE, capture pointers to bigger data
+        template<typename Function>
+        void Run(Function function, JobCounter* counter);
+        // like Run for the jobs that take long (a whole simulation step, loading a file). only the
+        // workers run them, never a Wait, so they dont end up running inside an unrelated wait.
+        // with no workers they run right away in this thread. dont Wait on them from a job
+        template<typename Function>
+        void RunLong(Function function, JobCounter* counter);
+        // run jobs until the counter gets to zero. the thread help with any job but the long ones,
+        // not only the jobs of this counter, because those can be behind others in the deques. each
+        // nested Wait grow the stack and put the profiler scopes of the jobs it run under this one,
+        // so past RUBY_JOB_MAX_WAIT_DEPTH nested waits the thread only sleep. the last thread that
+        // still help never stop, somebody has to run the jobs
+        void Wait(JobCounter* counter);
+        // call function(begin, end) for the ranges of grain elements in [first, first + count) and
+        // wait for all of them. the ranges only depend on the arguments, not on the threads
+        template<typename Function>
+        void ParallelFor(UINT32 first, UINT32 count, UINT32 grain, Function function);
+
+        UINT32 GetThreadCount() { return mThreadCount; }
+        // one thread per hardware thread
+        static UINT32 GetDefaultThreadCount();
+        // index of the calling thread in this system or RUBY_JOB_EXTERNAL_THREAD
+        UINT32 GetThreadIndex();
+    };
+
+    template<typename Function>
+    void JobSystem::MakeJob(Job& job, Function function, JobCounter* counter)
+    {
+        static_assert(sizeof(Function) <= RUBY_JOB_DATA_SIZE, "job closure too big");
+        static_assert(alignof(Function) <= 16, "job closure alignment too big");
+        static_assert(std::is_trivially_copyable<Function>::value, "job closure has to be trivially copyable");
+
+        job.mFunction = [](Job* job) { (*(Function*)job->mData)(); };
+        job.mCounter = counter;
+        new (job.mData) Function(function);
+
+        if (counter) counter->mCount.fetch_add(1);
+    }
+
+    template<typename Function>
+    void JobSystem::Run(Function function, JobCounter* counter)
+    {
+        Job job;
+        MakeJob(job, function, counter);
+        Push(job);
+    }
+
+    template<typename Function>
+    void JobSystem::RunLong(Function function, JobCounter* counter)
+    {
+        Job job;
+        MakeJob(job, function, counter);
+        PushLong(job);
+    }
+
+    template<typename Function>
+    void JobSystem::ParallelFor(UINT32 first, UINT32 count, UINT32 grain, Function function)
+    {
+        if (grain < 1) grain = 1;
+        // the jobs only take a pointer, function stay alive in this frame until the Wait
+        Function* f = &function;
+        JobCounter counter;
+        UINT32 end = first + count;
+        for (UINT32 begin = first; begin < end; begin += grain)
+        {
+            UINT32 rangeEnd = end - begin > grain ? begin + grain : end;
+            Run([f, begin, rangeEnd]() { (*f)(begin, rangeEnd); }, &counter);
+        }
+        Wait(&counter);
+    }
+
+    // tasks with dependencies that are build once and run many times (for example once per frame).
+    // a task start as a job when all the tasks it depends on are done, the graph has to be acyclic
+    class TaskGraph
+    {
+    private:
+        struct Task
+        {
+            const char* mName;
+            std::function<void()> mFunction;
+            std::vector<UINT32> mSuccessors;
+            UINT32 mDependencyCount;
+        };
+
+        std::vector<Task> mTasks;
+        // dependencies not done yet of each task while the graph run
+        std::atomic<UINT32>* mPending;
+        UINT32 mPendingCount;
+
+        void RunTask(JobSystem* jobs, UINT32 task, JobCounter* counter);
+    public:
+        TaskGraph() : mPending(nullptr), mPendingCount(0) {};
+        ~TaskGraph();
+
+        UINT32 AddTask(const char* name, std::function<void()> function);
+        // after only start when before is done
+        void AddDependency(UINT32 before, UINT32 after);
+        // run all the tasks once and wait for them
+        void Run(JobSystem* jobs);
+
+        UINT32 GetTaskCount() { return (UINT32)mTasks.size(); }
+        const char* GetTaskName(UINT32 task) { return mTasks[task].mName; }
+    };
+}
@@ -0,0 +1,227 @@
+#include "RubyLooseOctree.h"
+
+#include <math.h>
+
+namespace Ruby
+{
+    LooseOctree::LooseOctree(XMFLOAT3 center, float halfWidth, UINT32 maxDepth, UINT32 maxObjects)
+        : mCenter(center),
+        mHalfWidth(halfWidth),
+        mMaxDepth(maxDepth),
+        mFirstFree(RUBY_LOOSE_OCTREE_INVALID),
+        mObjectCount(0)
+    {
+        UINT32 cellCount = 0;
+        for (UINT32 level = 0; level <= mMaxDepth; ++level)
+        {
+            UINT32 n = 1 << level;
+            mLevelOffset.push_back(cellCount);
+            cellCount += n * n * n;
+        }
+        mLevelCount.resize(mMaxDepth + 1, 0);
+        mCellHead.resize(cellCount, RUBY_LOOSE_OCTREE_INVALID);
+        mObjects.reserve(maxObjects);
+    }
+
+    void LooseOctree::GetCell(XMFLOAT3 c, XMFLOAT3 r, UINT32& cell, UINT32& level)
+    {
+        float minX = mCenter.x - mHalfWidth;
+        float minY = mCenter.y - mHalfWidth;
+        float minZ = mCenter.z - mHalfWidth;
+
+        // objects with the center outside the tree go to the root, the root is always query
+        if (c.x < minX || c.y < minY || c.z < minZ ||
+            c.x >= mCenter.x + mHalfWidth || c.y >= mCenter.y + mHalfWidth || c.z >= mCenter.z + mHalfWidth)
+        {
+            level = 0;
+            cell = 0;
+            return;
+        }
+
+        // the deepest level where the object half size fit in the node half width
+        float radius = fmaxf(r.x, fmaxf(r.y, r.z));
+        if (radius <= 0.0f)
+        {
+            level = mMaxDepth;
+        }
+        else
+        {
+            float levelFloat = floorf(log2f(mHalfWidth / radius));
+            if (levelFloat < 0.0f) levelFloat = 0.0f;
+            level = levelFloat > (float)mMaxDepth ? mMaxDepth : (UINT32)levelFloat;
+        }
+
+        UINT32 n = 1 << level;
+        float invCellSize = (float)n / (mHalfWidth * 2.0f);
+        UINT32 x = (UINT32)((c.x - minX) * invCellSize);
+        UINT32 y = (UINT32)((c.y - minY) * invCellSize);
+        UINT32 z = (UINT32)((c.z - minZ) * invCellSize);
+        if (x >= n) x = n - 1;
+        if (y >= n) y = n - 1;
+        if (z >= n) z = n - 1;
+
+        cell = mLevelOffset[level] + (z * n + y) * n + x;
+    }
+
+    void LooseOctree::Link(UINT32 id, UINT32 cell, UINT32 level)
+    {
+        Object& object = mObjects[id];
+        object.mCell = cell;
+        object.mLevel = level;
+        object.mPrev = RUBY_LOOSE_OCTREE_INVALID;
+        object.mNext = mCellHead[cell];
+        if (object.mNext != RUBY_LOOSE_OCTREE_INVALID)
+        {
+            mObjects[object.mNext].mPrev = id;
+        }
+        mCellHead[cell] = id;
+        ++mLevelCount[level];
+    }
+
+    void LooseOctree::Unlink(UINT32 id)
+    {
+        Object& object = mObjects[id];
+        if (object.mPrev != RUBY_LOOSE_OCTREE_INVALID)
+        {
+            mObjects[object.mPrev].mNext = object.mNext;
+        }
+        else
+        {
+            mCellHead[object.mCell] = object.mNext;
+        }
+        if (object.mNext != RUBY_LOOSE_OCTREE_INVALID)
+        {
+            mObjects[object.mNext].mPrev = object.mPrev;
+        }
+        --mLevelCount[object.mLevel];
+    }
+
+    UINT32 LooseOctree::Insert(XMFLOAT3 c, XMFLOAT3 r, void* userData)
+    {
+        UINT32 id = mFirstFree;
+        if (id != RUBY_LOOSE_OCTREE_INVALID)
+        {
+            mFirstFree = mObjects[id].mNext;
+        }
+        else
+        {
+            id = (UINT32)mObjects.size();
+            mObjects.push_back(Object{});
+        }
+
+        Object& object = mObjects[id];
+        object.c = c;
+        object.r = r;
+        object.mUserData = userData;
+
+        UINT32 cell, level;
+        GetCell(c, r, cell, level);
+        Link(id, cell, level);
+        ++mObjectCount;
+        return id;
+    }
+
+    void LooseOctree::Remove(UINT32 id)
+    {
+        Unlink(id);
+        Object& object = mObjects[id];
+        object.mUserData = nullptr;
+        object.mCell = RUBY_LOOSE_OCTREE_INVALID;
+        object.mNext = mFirstFree;
+        mFirstFree = id;
+        --mObjectCount;
+    }
+
+    void LooseOctree::Move(UINT32 id, XMFLOAT3 c, XMFLOAT3 r)
+    {
+        Object& object = mObjects[id];
+        object.c = c;
+        object.r = r;
+
+        UINT32 cell, level;
+        GetCell(c, r, cell, level);
+        if (cell != object.mCell)
+        {
+            Unlink(id);
+            Link(id, cell, level);
+        }
+    }
+
+    UINT32 LooseOctree::Query(XMFLOAT3 c, XMFLOAT3 r, UINT32* result, UINT32 maxCount)
+    {
+        UINT32 count = 0;
+        float minX = mCenter.x - mHalfWidth;
+        float minY = mCenter.y - mHalfWidth;
+        float minZ = mCenter.z - mHalfWidth;
+
+        for (UINT32 level = 0; level <= mMaxDepth; ++level)
+        {
+            if (mLevelCount[level] == 0) continue;
+
+            // the objects of a cell can stick out of it by the node half width,
+            // so we grow the query box by that amount before finding the cells
+            UINT32 n = 1 << level;
+            float cellHalfWidth = mHalfWidth / (float)n;
+            float invCellSize = (float)n / (mHalfWidth * 2.0f);
+
+            int x0 = (int)floorf((c.x - r.x - cellHalfWidth - minX) * invCellSize);
+            int y0 = (int)floorf((c.y - r.y - cellHalfWidth - minY) * invCellSize);
+            int z0 = (int)floorf((c.z - r.z - cellHalfWidth - minZ) * invCellSize);
+            int x1 = (int)floorf((c.x + r.x + cellHalfWidth - minX) * invCellSize);
+            int y1 = (int)floorf((c.y + r.y + cellHalfWidth - minY) * invCellSize);
+            int z1 = (int)floorf((c.z + r.z + cellHalfWidth - minZ) * invCellSize);
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (z0 < 0) z0 = 0;
+            if (x1 > (int)n - 1) x1 = (int)n - 1;
+            if (y1 > (int)n - 1) y1 = (int)n - 1;
+            if (z1 > (int)n - 1) z1 = (int)n - 1;
+            if (level == 0)
+            {
+                // the root also hold the objects outside the tree
+                x0 = y0 = z0 = 0;
+                x1 = y1 = z1 = 0;
+            }
+
+            for (int z = z0; z <= z1; ++z)
+            {
+                for (int y = y0; y <= y1; ++y)
+                {
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        UINT32 id = mCellHead[mLevelOffset[level] + (z * n + y) * n + x];
+                        while (id != RUBY_LOOSE_OCTREE_INVALID)
+                        {
+                            Object& object = mObjects[id];
+                            if (fabsf(object.c.x - c.x) <= (object.r.x + r.x) &&
+                                fabsf(object.c.y - c.y) <= (object.r.y + r.y) &&
+                                fabsf(object.c.z - c.z) <= (object.r.z + r.z))
+                            {
+                                if (count == maxCount) return count;
+                                result[count++] = id;
+                            }
+                            id = object.mNext;
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    void* LooseOctree::GetUserData(UINT32 id)
+    {
+        return mObjects[id].mUserData;
+    }
+
+    void LooseOctree::GetBounds(UINT32 id, XMFLOAT3& c, XMFLOAT3& r)
+    {
+        c = mObjects[id].c;
+        r = mObjects[id].r;
+    }
+
+    UINT32 LooseOctree::GetObjectCount()
+    {
+        return mObjectCount;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "RubyTypes.h"
+#include <DirectXMath.h>
+#include <vector>
+
+using namespace DirectX;
+
+#define RUBY_LOOSE_OCTREE_INVALID 0xFFFFFFFF
+
+namespace Ruby
+{
+    // loose octree for objects that move every frame. every level is a full grid of cells
+    // and the cells are twice the size of the octree node (loose factor 2), so the level and the
+    // cell of an object can be computed directly from its bounds: Insert, Remove and Move are O(1)
+    // and there is no clipping, an object lives in exactly one cell
+    class LooseOctree
+    {
+    private:
+        struct Object
+        {
+            XMFLOAT3 c;
+            XMFLOAT3 r;
+            void* mUserData;
+            UINT32 mCell;
+            UINT32 mLevel;
+            UINT32 mPrev;
+            UINT32 mNext; // also used for the free list
+        };
+
+        XMFLOAT3 mCenter;
+        float mHalfWidth;
+        UINT32 mMaxDepth;
+
+        std::vector<UINT32> mLevelOffset; // first cell of each level in mCellHead
+        std::vector<UINT32> mLevelCount;  // objects in each level, empty levels are skip in the query
+        std::vector<UINT32> mCellHead;    // first object of each cell
+
+        std::vector<Object> mObjects;
+        UINT32 mFirstFree;
+        UINT32 mObjectCount;
+
+        void GetCell(XMFLOAT3 c, XMFLOAT3 r, UINT32& cell, UINT32& level);
+        void Link(UINT32 id, UINT32 cell, UINT32 level);
+        void Unlink(UINT32 id);
+    public:
+        LooseOctree(XMFLOAT3 center, float halfWidth, UINT32 maxDepth, UINT32 maxObjects);
+        ~LooseOctree() {};
+
+        // c is the center and r the half size of the object bounds
+        UINT32 Insert(XMFLOAT3 c, XMFLOAT3 r, void* userData);
+        void Remove(UINT32 id);
+        void Move(UINT32 id, XMFLOAT3 c, XMFLOAT3 r);
+
+        // write the id of the objects that overlap the box, return how many were written
+        UINT32 Query(XMFLOAT3 c, XMFLOAT3 r, UINT32* result, UINT32 maxCount);
+
+        void* GetUserData(UINT32 id);
+        void GetBounds(UINT32 id, XMFLOAT3& c, XMFLOAT3& r);
+        UINT32 GetObjectCount();
+    };
+}
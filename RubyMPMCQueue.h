@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include "RubyTypes.h"
+
+// set in the tail of a ring when the producers have to move to the next one
+#define RUBY_MPMC_CLOSED 0x8000000000000000ull
+
+namespace Ruby
+{
+    // lock-free multi producer multi consumer queue without a fixed capacity. the values live
+    // in bounded rings (Vyukov's queue, one sequence number per slot). when the last ring is
+    // full a ring twice as big is chained after it and the full one is closed, the consumers
+    // move to the next ring once a closed ring is empty. the rings are only freed with the
+    // queue, so a thread that still read an old ring is always safe and the memory is at most
+    // twice the biggest amount of values the queue ever had. the order is only FIFO inside a ring
+    template<typename T>
+    class MPMCQueue
+    {
+    private:
+        struct Slot
+        {
+            std::atomic<UINT64> mSequence;
+            T mValue;
+        };
+
+        struct Ring
+        {
+            alignas(64) std::atomic<UINT64> mHead;
+            alignas(64) std::atomic<UINT64> mTail;
+            std::atomic<Ring*> mNext;
+            UINT64 mMask;
+            Slot* mSlots;
+        };
+
+        alignas(64) std::atomic<Ring*> mHead;
+        alignas(64) std::atomic<Ring*> mTail;
+        Ring* mFirst;
+
+        static Ring* CreateRing(UINT64 size);
+        static void DestroyRing(Ring* ring);
+        static bool RingPush(Ring* ring, const T& value);
+        static bool RingPop(Ring* ring, T& value);
+    public:
+        // capacity is only the size of the first ring, it is round up to a power of two
+        MPMCQueue(UINT32 capacity);
+        ~MPMCQueue();
+
+        void Push(const T& value);
+        // false when the queue is empty, or when the next value is still being written
+        bool Pop(T& value);
+    };
+
+    template<typename T>
+    typename MPMCQueue<T>::Ring* MPMCQueue<T>::CreateRing(UINT64 size)
+    {
+        Ring* ring = new Ring();
+        ring->mHead.store(0);
+        ring->mTail.store(0);
+        ring->mNext.store(nullptr);
+        ring->mMask = size - 1;
+        ring->mSlots = new Slot[size];
+        for (UINT64 i = 0; i < size; ++i)
+        {
+            ring->mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+        }
+        return ring;
+    }
+
+    template<typename T>
+    void MPMCQueue<T>::DestroyRing(Ring* ring)
+    {
+        delete[] ring->mSlots;
+        delete ring;
+    }
+
+    template<typename T>
+    MPMCQueue<T>::MPMCQueue(UINT32 capacity)
+    {
+        UINT64 size = 2;
+        while (size < capacity) size *= 2;
+        mFirst = CreateRing(size);
+        mHead.store(mFirst);
+        mTail.store(mFirst);
+    }
+
+    template<typename T>
+    MPMCQueue<T>::~MPMCQueue()
+    {
+        Ring* ring = mFirst;
+        while (ring)
+        {
+            Ring* next = ring->mNext.load();
+            DestroyRing(ring);
+            ring = next;
+        }
+    }
+
+    template<typename T>
+    bool MPMCQueue<T>::RingPush(Ring* ring, const T& value)
+    {
+        UINT64 pos = ring->mTail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (pos & RUBY_MPMC_CLOSED) return false;
+
+            Slot& slot = ring->mSlots[pos & ring->mMask];
+            INT64 diff = (INT64)slot.mSequence.load(std::memory_order_acquire) - (INT64)pos;
+            if (diff == 0)
+            {
+                // the slot is free, claim it
+                if (ring->mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.mValue = value;
+                    slot.mSequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // full, the slot still has the value of the previous lap
+                return false;
+            }
+            else
+            {
+                pos = ring->mTail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<typename T>
+    bool MPMCQueue<T>::RingPop(Ring* ring, T& value)
+    {
+        UINT64 pos = ring->mHead.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = ring->mSlots[pos & ring->mMask];
+            INT64 diff = (INT64)slot.mSequence.load(std::memory_order_acquire) - (INT64)(pos + 1);
+            if (diff == 0)
+            {
+                if (ring->mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = slot.mValue;
+                    // free the slot for the next lap
+                    slot.mSequence.store(pos + ring->mMask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = ring->mHead.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<typename T>
+    void MPMCQueue<T>::Push(const T& value)
+    {
+        for (;;)
+        {
+            Ring* ring = mTail.load(std::memory_order_acquire);
+            if (RingPush(ring, value)) return;
+
+            // full or closed, go to the next ring and create it if nobody did
+            Ring* next = ring->mNext.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                Ring* newRing = CreateRing((ring->mMask + 1) * 2);
+                if (ring->mNext.compare_exchange_strong(next, newRing, std::memory_order_acq_rel))
+                {
+                    next = newRing;
+                }
+                else
+                {
+                    DestroyRing(newRing);
+                }
+            }
+            // closed after the link so a consumer that see it closed always find the next ring
+            ring->mTail.fetch_or(RUBY_MPMC_CLOSED, std::memory_order_acq_rel);
+            mTail.compare_exchange_strong(ring, next, std::memory_order_acq_rel);
+        }
+    }
+
+    template<typename T>
+    bool MPMCQueue<T>::Pop(T& value)
+    {
+        for (;;)
+        {
+            Ring* ring = mHead.load(std::memory_order_acquire);
+            if (RingPop(ring, value)) return true;
+
+            // a ring is done when it is closed and all the claimed slots were read
+            UINT64 tail = ring->mTail.load(std::memory_order_acquire);
+            if ((tail & RUBY_MPMC_CLOSED) == 0) return false;
+            if (ring->mHead.load(std::memory_order_acquire) != (tail & ~RUBY_MPMC_CLOSED)) return false;
+
+            Ring* next = ring->mNext.load(std::memory_order_acquire);
+            mHead.compare_exchange_strong(ring, next, std::memory_order_acq_rel);
+        }
+    }
+}
@@ -1,6 +1,10 @@
 #include "RubyMesh.h"
 
+#include <unordered_map>
+#include <stdio.h>
+
 #include "JsonParser/JsonParser.h"
+#include "RubyFrameStats.h"
 //#include "RubyDebugProfiler.h"
 
 // SSE2
@@ -20,6 +24,7 @@ namespace Ruby
     {
         Buffer result{};
 
+#ifdef _WIN32
         HANDLE hFile = CreateFileA(filepath, GENERIC_READ,
             FILE_SHARE_READ, 0, OPEN_EXISTING,
             FILE_ATTRIBUTE_NORMAL, 0);
@@ -50,6 +55,29 @@ namespace Ruby
         result.size = bytesReaded;
 
         CloseHandle(hFile);
+#else
+        FILE* file = fopen(filepath, "rb");
+        if (file == nullptr) {
+            printf("Error openging file: %s\n", filepath);
+            return result;
+        }
+
+        fseek(file, 0, SEEK_END);
+        long bytesToRead = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (bytesToRead <= 0)
+        {
+            printf("Error file: %s is empty\n", filepath);
+            fclose(file);
+            return result;
+        }
+
+        char* fileData = new char[bytesToRead];
+        result.data = (void*)fileData;
+        result.size = fread(fileData, 1, bytesToRead, file);
+
+        fclose(file);
+#endif
 
         return result;
 
@@ -95,17 +123,33 @@ namespace Ruby
 {
 
     MeshGeometry::MeshGeometry()
-        : mVB(nullptr), mIB(nullptr)
+        : mVertexStride(0), mBaseVertex(0), mBaseIndex(0)
     {
-
+#ifdef _WIN32
+        mVB = nullptr;
+        mIB = nullptr;
+#endif
     }
 
     MeshGeometry::~MeshGeometry()
     {
+#ifdef _WIN32
         if (mVB) mVB->Release();
         if (mIB) mIB->Release();
+#endif
     }
 
+    void MeshGeometry::SetSubsetTable(std::vector<Subset>& subsetTable)
+    {
+        mSubsetTable = subsetTable;
+    }
+
+    std::vector<Ruby::MeshGeometry::Subset>& MeshGeometry::GetSubsetTable()
+    {
+        return mSubsetTable;
+    }
+
+#ifdef _WIN32
     template<typename VertexType>
     void MeshGeometry::SetVertices(ID3D11Device* device, const VertexType* vertices, UINT count)
     {
@@ -152,16 +196,32 @@ namespace Ruby
         mIndicesCount = count;
     }
 
-    void MeshGeometry::SetSubsetTable(std::vector<Subset>& subsetTable)
+    void MeshGeometry::SetSharedBuffers(ID3D11Buffer* vb, ID3D11Buffer* ib, UINT vertexStride, UINT baseVertex, UINT baseIndex)
     {
-        mSubsetTable = subsetTable;
+        if (mVB) mVB->Release();
+        if (mIB) mIB->Release();
+
+        // the buffers are shared, every MeshGeometry hold its own reference
+        mVB = vb;
+        mIB = ib;
+        mVB->AddRef();
+        mIB->AddRef();
+
+        mIndexBufferFormat = DXGI_FORMAT_R16_UINT;
+        mVertexStride = vertexStride;
+        mBaseVertex = baseVertex;
+        mBaseIndex = baseIndex;
     }
 
-    std::vector<Ruby::MeshGeometry::Subset>& MeshGeometry::GetSubsetTable()
+    ID3D11Buffer* MeshGeometry::GetVertexBuffer()
     {
-        return mSubsetTable;
+        return mVB;
     }
 
+    ID3D11Buffer* MeshGeometry::GetIndexBuffer()
+    {
+        return mIB;
+    }
 
     void MeshGeometry::Draw(ID3D11DeviceContext* dc, UINT subsetId)
     {
@@ -169,13 +229,23 @@ namespace Ruby
         dc->IASetVertexBuffers(0, 1, &mVB, &mVertexStride, &offet);
         dc->IASetIndexBuffer(mIB, mIndexBufferFormat, 0);
         Subset subset = mSubsetTable[subsetId];
-        dc->DrawIndexed(subset.IndexCount, subset.IndexStart, 0);
+        dc->DrawIndexed(subset.IndexCount, mBaseIndex + subset.IndexStart, mBaseVertex);
+        FrameStats::AddDraw(subset.IndexCount / 3);
     }
 
     Mesh::Mesh(ID3D11Device* device,
                const std::string modelFilename,
                const std::string modelBinFilename,
                std::string textureFilepath)
+        : Mesh(modelFilename, modelBinFilename)
+    {
+        ModelMesh.SetVertices<Vertex>(device, Vertices.data(), Vertices.size());
+        ModelMesh.SetIndices(device, Indices.data(), Indices.size());
+    }
+#endif
+
+    Mesh::Mesh(const std::string modelFilename,
+               const std::string modelBinFilename)
         : ModelMesh()
     {
 
@@ -296,10 +366,8 @@ namespace Ruby
             Mat.push_back(material);
         }
 
-        delete bin.data;
+        delete[] (char*)bin.data;
 
-        ModelMesh.SetVertices<Vertex>(device, Vertices.data(), Vertices.size());
-        ModelMesh.SetIndices(device, Indices.data(), Indices.size());
         ModelMesh.SetSubsetTable(subsetTable);
     }
 
@@ -390,10 +458,113 @@ namespace Ruby
 
 // this one os broken but it takes only tree sec so try to make it work ...
 #if 1
-    Mesh* Mesh::Clip(ID3D11Device* device, Plane& plane)
+    // the key of a cut edge is the ordered index pair, so the two triangles that share
+    // the edge find the same vertex. the plane is the same for the whole Clip call
+    inline UINT32 EdgeKey(USHORT indexA, USHORT indexB)
+    {
+        return indexA < indexB ? ((UINT32)indexA << 16) | indexB : ((UINT32)indexB << 16) | indexA;
+    }
+
+    static USHORT GetEdgeVertex(std::unordered_map<UINT32, USHORT>& edgeCache, std::vector<Vertex>& vertices,
+                                const Vertex& vertexA, const Vertex& vertexB,
+                                USHORT indexA, USHORT indexB,
+                                float distA, float distB)
+    {
+        UINT32 key = EdgeKey(indexA, indexB);
+        auto it = edgeCache.find(key);
+        if (it != edgeCache.end())
+        {
+            return it->second;
+        }
+
+        // same t as Line::IntersectPlane but from the distances we already have
+        float tout = distA / (distA - distB);
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 t = _mm_set1_ps(tout);
+
+        __m128 posA = _mm_set_ps(1.0f, vertexA.Position.z, vertexA.Position.y, vertexA.Position.x);
+        __m128 norA = _mm_set_ps(0.0f, vertexA.Normal.z, vertexA.Normal.y, vertexA.Normal.x);
+        __m128 tanA = _mm_set_ps(vertexA.TangentU.w, vertexA.TangentU.z, vertexA.TangentU.y, vertexA.TangentU.x);
+        __m128 texA = _mm_set_ps(0.0f, 0.0f, vertexA.TexC.y, vertexA.TexC.x);
+
+        __m128 posB = _mm_set_ps(1.0f, vertexB.Position.z, vertexB.Position.y, vertexB.Position.x);
+        __m128 norB = _mm_set_ps(0.0f, vertexB.Normal.z, vertexB.Normal.y, vertexB.Normal.x);
+        __m128 tanB = _mm_set_ps(vertexB.TangentU.w, vertexB.TangentU.z, vertexB.TangentU.y, vertexB.TangentU.x);
+        __m128 texB = _mm_set_ps(0.0f, 0.0f, vertexB.TexC.y, vertexB.TexC.x);
+
+        __m128 vertPos = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), posA), _mm_mul_ps(t, posB));
+        __m128 vertNor = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), norA), _mm_mul_ps(t, norB));
+        __m128 vertTan = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), tanA), _mm_mul_ps(t, tanB));
+        __m128 vertTex = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), texA), _mm_mul_ps(t, texB));
+
+        Vertex vertex;
+        vertex.Position.x = M(vertPos, 0);
+        vertex.Position.y = M(vertPos, 1);
+        vertex.Position.z = M(vertPos, 2);
+        vertex.Normal.x = M(vertNor, 0);
+        vertex.Normal.y = M(vertNor, 1);
+        vertex.Normal.z = M(vertNor, 2);
+        vertex.TangentU.x = M(vertTan, 0);
+        vertex.TangentU.y = M(vertTan, 1);
+        vertex.TangentU.z = M(vertTan, 2);
+        vertex.TangentU.w = M(vertTan, 3);
+        vertex.TexC.x = M(vertTex, 0);
+        vertex.TexC.y = M(vertTex, 1);
+
+        USHORT index = (USHORT)vertices.size();
+        vertices.push_back(vertex);
+        edgeCache.emplace(key, index);
+        return index;
+    }
+
+    // signed distance of every vertex to the plane. the positions are gather into
+    // SoA batches so one AVX op (or SSE without AVX) handle 8 (4) vertices at the time
+    static void ClassifyVertices(const Vertex* vertices, UINT count, const Plane& plane, float* distances)
+    {
+        UINT i = 0;
+#if defined(__AVX__)
+        __m256 nx = _mm256_set1_ps(plane.n.x);
+        __m256 ny = _mm256_set1_ps(plane.n.y);
+        __m256 nz = _mm256_set1_ps(plane.n.z);
+        __m256 d = _mm256_set1_ps(plane.d);
+        for (; i + 8 <= count; i += 8)
+        {
+            const Vertex* v = vertices + i;
+            __m256 x = _mm256_set_ps(v[7].Position.x, v[6].Position.x, v[5].Position.x, v[4].Position.x,
+                                     v[3].Position.x, v[2].Position.x, v[1].Position.x, v[0].Position.x);
+            __m256 y = _mm256_set_ps(v[7].Position.y, v[6].Position.y, v[5].Position.y, v[4].Position.y,
+                                     v[3].Position.y, v[2].Position.y, v[1].Position.y, v[0].Position.y);
+            __m256 z = _mm256_set_ps(v[7].Position.z, v[6].Position.z, v[5].Position.z, v[4].Position.z,
+                                     v[3].Position.z, v[2].Position.z, v[1].Position.z, v[0].Position.z);
+            __m256 dist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, nx), _mm256_mul_ps(y, ny)),
+                                                      _mm256_mul_ps(z, nz)), d);
+            _mm256_storeu_ps(distances + i, dist);
+        }
+#endif
+        __m128 nx4 = _mm_set1_ps(plane.n.x);
+        __m128 ny4 = _mm_set1_ps(plane.n.y);
+        __m128 nz4 = _mm_set1_ps(plane.n.z);
+        __m128 d4 = _mm_set1_ps(plane.d);
+        for (; i + 4 <= count; i += 4)
+        {
+            const Vertex* v = vertices + i;
+            __m128 x = _mm_set_ps(v[3].Position.x, v[2].Position.x, v[1].Position.x, v[0].Position.x);
+            __m128 y = _mm_set_ps(v[3].Position.y, v[2].Position.y, v[1].Position.y, v[0].Position.y);
+            __m128 z = _mm_set_ps(v[3].Position.z, v[2].Position.z, v[1].Position.z, v[0].Position.z);
+            __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, nx4), _mm_mul_ps(y, ny4)),
+                                                _mm_mul_ps(z, nz4)), d4);
+            _mm_storeu_ps(distances + i, dist);
+        }
+        for (; i < count; ++i)
+        {
+            XMFLOAT3 p = vertices[i].Position;
+            distances[i] = p.x * plane.n.x + p.y * plane.n.y + p.z * plane.n.z - plane.d;
+        }
+    }
+
+    Mesh* Mesh::Clip(Plane& plane)
     {
-        // TODO: not create a IndexBuffer when it its nothing to draw
-        // use a single vertexBuffer with all the vertex
         Mesh* result = new Mesh();
         result->Mat = Mat;
         result->Vertices = Vertices;
@@ -406,10 +577,18 @@ namespace Ruby
 
         USHORT* indices = (USHORT*)malloc(sizeof(USHORT) * Indices.size() * 2);
         UINT indicesCount = 0;
+
+        // one new vertex per cut edge, shared by every triangle that uses the edge
+        std::unordered_map<UINT32, USHORT> edgeCache;
+        edgeCache.reserve(Indices.size() / 4);
         
         XMVECTOR N = XMVector3Normalize(XMVectorSet(plane.n.x, plane.n.y, plane.n.z, 0.0f));
         XMStoreFloat3(&plane.n, N);
 
+        // classify all the vertices one time, the triangle loop only read the distances
+        float* distances = (float*)malloc(sizeof(float) * Vertices.size());
+        ClassifyVertices(Vertices.data(), Vertices.size(), plane, distances);
+
         for (int j = 0; j < subsetCount; ++j)
         {
             MeshGeometry::Subset subset = subsets[j];
@@ -417,139 +596,60 @@ namespace Ruby
             // for each triangle, try to clip it to the plane
             for (int i = subset.IndexStart; i < (subset.IndexStart + subset.IndexCount); i += 3)
             {
-                // first need to see if the triangle intersect the plane
-                // we thest the tree edges
-                XMFLOAT3 vert0 = Vertices[Indices[i + 0]].Position;
-                XMFLOAT3 vert1 = Vertices[Indices[i + 1]].Position;
-                XMFLOAT3 vert2 = Vertices[Indices[i + 2]].Position;
-
-                Line edges[3] = {
-                    { vert0, vert1 },
-                    { vert1, vert2 },
-                    { vert2, vert0 }
+                USHORT triangleIndices[4] = {
+                    Indices[i + 0], Indices[i + 1], Indices[i + 2], Indices[i + 0]
                 };
-                Vertex triangleVertex[6] = {
-                    Vertices[Indices[i + 0]], Vertices[Indices[i + 1]],
-                    Vertices[Indices[i + 1]], Vertices[Indices[i + 2]],
-                    Vertices[Indices[i + 2]], Vertices[Indices[i + 0]]
-                };
-                USHORT triangleIndices[6] = {
-                    Indices[i + 0], Indices[i + 1],
-                    Indices[i + 1], Indices[i + 2],
-                    Indices[i + 2], Indices[i + 0]
+                float triangleDistances[4] = {
+                    distances[triangleIndices[0]], distances[triangleIndices[1]],
+                    distances[triangleIndices[2]], distances[triangleIndices[0]]
                 };
 
-                UINT vertexIndex = 0;
+                // fast paths, the whole triangle is in front or behind the plane
+                // so we dont need to touch the vertex attributes
+                int frontCount = (triangleDistances[0] >= 0.0f) + (triangleDistances[1] >= 0.0f) + (triangleDistances[2] >= 0.0f);
+                if (frontCount == 3)
+                {
+                    indices[indicesCount + 0] = triangleIndices[0];
+                    indices[indicesCount + 1] = triangleIndices[1];
+                    indices[indicesCount + 2] = triangleIndices[2];
+                    indicesCount += 3;
+                    continue;
+                }
+                if (frontCount == 0)
+                {
+                    continue;
+                }
 
+                // the triangle intersect the plane, we walk the tree edges
                 USHORT newIndices[4];
                 UINT newIncicesCount = 0;
 
                 for (int edgeIndex = 0; edgeIndex < 3; ++edgeIndex)
                 {
-                    Line edge = edges[edgeIndex];
-                    
-                    XMVECTOR A = XMVectorSet(edge.a.x, edge.a.y, edge.a.z, 1.0f);
-                    XMVECTOR B = XMVectorSet(edge.b.x, edge.b.y, edge.b.z, 1.0f);
-
-                    XMVECTOR O = N * plane.d;
-
-                    XMVECTOR dotA = XMVector3Dot(A - O, N);
-                    XMVECTOR dotB = XMVector3Dot(B - O, N);
-
-                    XMFLOAT3 dotAFloat;
-                    XMStoreFloat3(&dotAFloat, dotA);
-
-                    XMFLOAT3 dotBFloat;
-                    XMStoreFloat3(&dotBFloat, dotB);
-
-                    Vertex vertexA = triangleVertex[vertexIndex + 0];
-                    
-                    __m128 one = _mm_set1_ps(1.0f);
-
-                    __m128 posA = _mm_set_ps(1.0f, vertexA.Position.z, vertexA.Position.y, vertexA.Position.x);
-
-                    __m128 norA = _mm_set_ps(0.0f, vertexA.Normal.z, vertexA.Normal.y, vertexA.Normal.x);
-                    __m128 tanA = _mm_set_ps(vertexA.TangentU.w, vertexA.TangentU.z, vertexA.TangentU.y, vertexA.TangentU.x);
-                    __m128 texA = _mm_set_ps(0.0f, 0.0f, vertexA.TexC.y, vertexA.TexC.x);
-
-                    Vertex vertexB = triangleVertex[vertexIndex + 1];
-
-                    __m128 posB = _mm_set_ps(1.0f, vertexB.Position.z, vertexB.Position.y, vertexB.Position.x);
-                    __m128 norB = _mm_set_ps(0.0f, vertexB.Normal.z, vertexB.Normal.y, vertexB.Normal.x);
-                    __m128 tanB = _mm_set_ps(vertexB.TangentU.w, vertexB.TangentU.z, vertexB.TangentU.y, vertexB.TangentU.x);
-                    __m128 texB = _mm_set_ps(0.0f, 0.0f, vertexB.TexC.y, vertexB.TexC.x);
-
-                    USHORT indexA = triangleIndices[vertexIndex + 0];
-                    USHORT indexB = triangleIndices[vertexIndex + 1];
+                    USHORT indexA = triangleIndices[edgeIndex + 0];
+                    USHORT indexB = triangleIndices[edgeIndex + 1];
+                    float distA = triangleDistances[edgeIndex + 0];
+                    float distB = triangleDistances[edgeIndex + 1];
 
                     // we dont want to recreate the vertices, we want to add new vertices and reac reate the indices
-                    if (dotAFloat.x >= 0.0f && dotBFloat.x >= 0.0f)
+                    if (distA >= 0.0f && distB >= 0.0f)
                     {
                         // Here we know the edge not intersect the plane
                         newIndices[newIncicesCount++] = indexB;
                     }
-                    else if (dotAFloat.x >= 0.0f && dotBFloat.x < 0.0f)
+                    else if (distA >= 0.0f && distB < 0.0f)
                     {
-                        float tout = 0.0f;
-                        edge.IntersectPlane(plane, tout);
-
-                        __m128 t = _mm_set1_ps(tout);
-
-                        __m128 vertPos = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), posA), _mm_mul_ps(t, posB));
-                        __m128 vertNor = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), norA), _mm_mul_ps(t, norB));
-                        __m128 vertTan = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), tanA), _mm_mul_ps(t, tanB));
-                        __m128 vertTex = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), texA), _mm_mul_ps(t, texB));
-
-                        Vertex vertex;
-                        vertex.Position.x = M(vertPos, 0);
-                        vertex.Position.y = M(vertPos, 1);
-                        vertex.Position.z = M(vertPos, 2);
-                        vertex.Normal.x = M(vertNor, 0);
-                        vertex.Normal.y = M(vertNor, 1);
-                        vertex.Normal.z = M(vertNor, 2);
-                        vertex.TangentU.x = M(vertTan, 0);
-                        vertex.TangentU.y = M(vertTan, 1);
-                        vertex.TangentU.z = M(vertTan, 2);
-                        vertex.TangentU.w = M(vertTan, 3);
-                        vertex.TexC.x = M(vertTex, 0);
-                        vertex.TexC.y = M(vertTex, 1);
-
-                        newIndices[newIncicesCount++] = result->Vertices.size();
-                        result->Vertices.push_back(vertex);
+                        newIndices[newIncicesCount++] = GetEdgeVertex(edgeCache, result->Vertices,
+                            Vertices[indexA], Vertices[indexB],
+                            indexA, indexB, distA, distB);
                     }
-                    else if (dotAFloat.x < 0.0f && dotBFloat.x >= 0.0f)
+                    else if (distA < 0.0f && distB >= 0.0f)
                     {
-                        float tout = 0.0f;
-                        edge.IntersectPlane(plane, tout);
-
-                        __m128 t = _mm_set1_ps(tout);
-
-                        __m128 vertPos = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), posA), _mm_mul_ps(t, posB));
-                        __m128 vertNor = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), norA), _mm_mul_ps(t, norB));
-                        __m128 vertTan = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), tanA), _mm_mul_ps(t, tanB));
-                        __m128 vertTex = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), texA), _mm_mul_ps(t, texB));
-
-                        Vertex vertex;
-                        vertex.Position.x = M(vertPos, 0);
-                        vertex.Position.y = M(vertPos, 1);
-                        vertex.Position.z = M(vertPos, 2);
-                        vertex.Normal.x = M(vertNor, 0);
-                        vertex.Normal.y = M(vertNor, 1);
-                        vertex.Normal.z = M(vertNor, 2);
-                        vertex.TangentU.x = M(vertTan, 0);
-                        vertex.TangentU.y = M(vertTan, 1);
-                        vertex.TangentU.z = M(vertTan, 2);
-                        vertex.TangentU.w = M(vertTan, 3);
-                        vertex.TexC.x = M(vertTex, 0);
-                        vertex.TexC.y = M(vertTex, 1);
-
-                        newIndices[newIncicesCount++] = result->Vertices.size();
-                        newIndices[newIncicesCount++]  = indexB;
-                        result->Vertices.push_back(vertex);
+                        newIndices[newIncicesCount++] = GetEdgeVertex(edgeCache, result->Vertices,
+                            Vertices[indexA], Vertices[indexB],
+                            indexA, indexB, distA, distB);
+                        newIndices[newIncicesCount++] = indexB;
                     }
-
-                    vertexIndex += 2;
-
                 }
 
                 // now we have the clip rectangle
@@ -579,15 +679,14 @@ namespace Ruby
                     indices[indicesCount + index] = triagulazedIndices[index];
                 }
                 indicesCount += triagulazedIndicesCount;
-
-                
-
             }
             subset.IndexStart = indexStart;
             subset.IndexCount = indicesCount - subset.IndexStart;
             newSubsets[j] = subset;
         }
 
+        free(distances);
+
         if (indicesCount == 0)
         {
             free(newSubsets);
@@ -599,8 +698,6 @@ namespace Ruby
         std::vector<USHORT> finalIndices(indices, indices + indicesCount);
         std::vector<MeshGeometry::Subset> finalSubset(newSubsets, newSubsets + subsetCount);
 
-        result->ModelMesh.SetVertices(device, result->Vertices.data(), result->Vertices.size());
-        result->ModelMesh.SetIndices(device, indices, indicesCount);
         result->ModelMesh.SetSubsetTable(finalSubset);
         result->Indices = finalIndices;
 
@@ -611,11 +708,8 @@ namespace Ruby
     }
 
 #else
-    Mesh* Mesh::Clip(ID3D11Device* device, Plane& plane)
+    Mesh* Mesh::Clip(Plane& plane)
     {
-        // TODO: not create a IndexBuffer when it its nothing to draw
-        // use a single vertexBuffer with all the vertex
-
         Mesh* result = new Mesh();
         result->Mat = Mat;
         result->Vertices = Vertices;
@@ -746,8 +840,6 @@ namespace Ruby
             delete result;
             return nullptr;
         }
-        result->ModelMesh.SetVertices(device, result->Vertices.data(), result->Vertices.size());
-        result->ModelMesh.SetIndices(device, indices.data(), indices.size());
         result->ModelMesh.SetSubsetTable(newSubsets);
         result->Indices = indices;
         return result;
@@ -758,6 +850,82 @@ namespace Ruby
 
 
 
+    void Mesh::RemoveUnusedVertices()
+    {
+        const USHORT unused = 0xFFFF;
+        std::vector<USHORT> remap(Vertices.size(), unused);
+        std::vector<Vertex> vertices;
+        vertices.reserve(Vertices.size());
+        for (UINT i = 0; i < Indices.size(); ++i)
+        {
+            USHORT& newIndex = remap[Indices[i]];
+            if (newIndex == unused)
+            {
+                newIndex = (USHORT)vertices.size();
+                vertices.push_back(Vertices[Indices[i]]);
+            }
+            Indices[i] = newIndex;
+        }
+        Vertices.swap(vertices);
+    }
+
+#ifdef _WIN32
+    static void CreateSharedBuffers(ID3D11Device* device, Mesh** meshes, UINT count,
+                                    UINT vertexCount, UINT indexCount)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<USHORT> indices;
+        vertices.reserve(vertexCount);
+        indices.reserve(indexCount);
+        for (UINT i = 0; i < count; ++i)
+        {
+            vertices.insert(vertices.end(), meshes[i]->Vertices.begin(), meshes[i]->Vertices.end());
+            indices.insert(indices.end(), meshes[i]->Indices.begin(), meshes[i]->Indices.end());
+        }
+
+        // we use a tmp MeshGeometry to create the buffers and then every mesh get a reference to them
+        MeshGeometry shared;
+        shared.SetVertices<Vertex>(device, vertices.data(), vertices.size());
+        shared.SetIndices(device, indices.data(), indices.size());
+
+        UINT baseVertex = 0;
+        UINT baseIndex = 0;
+        for (UINT i = 0; i < count; ++i)
+        {
+            meshes[i]->ModelMesh.SetSharedBuffers(shared.GetVertexBuffer(), shared.GetIndexBuffer(),
+                                                  sizeof(Vertex), baseVertex, baseIndex);
+            baseVertex += meshes[i]->Vertices.size();
+            baseIndex += meshes[i]->Indices.size();
+        }
+    }
+
+    void UploadMeshes(ID3D11Device* device, Mesh** meshes, UINT count)
+    {
+        UINT first = 0;
+        UINT vertexCount = 0;
+        UINT indexCount = 0;
+        for (UINT i = 0; i < count; ++i)
+        {
+            UINT meshVertexCount = meshes[i]->Vertices.size();
+            UINT meshIndexCount = meshes[i]->Indices.size();
+            // start a new pair of buffers if this mesh dont fit in the current one
+            if (i > first && (vertexCount + meshVertexCount) * sizeof(Vertex) > RUBY_MAX_SHARED_BUFFER_BYTES)
+            {
+                CreateSharedBuffers(device, meshes + first, i - first, vertexCount, indexCount);
+                first = i;
+                vertexCount = 0;
+                indexCount = 0;
+            }
+            vertexCount += meshVertexCount;
+            indexCount += meshIndexCount;
+        }
+        if (count > first)
+        {
+            CreateSharedBuffers(device, meshes + first, count - first, vertexCount, indexCount);
+        }
+    }
+#endif
+
     void Mesh::GetBoundingBox(XMFLOAT3& min, XMFLOAT3& max)
     {
         float minX = FLT_MAX;
@@ -1,7 +1,9 @@
 #pragma once
 
+#ifdef _WIN32
 #include <d3d11.h>
 #include <d3dx11.h>
+#endif
 #include <DirectXMath.h>
 
 #include <vector>
@@ -10,6 +12,8 @@
 #include "LightHelper.h"
 #include "GeometryGenerator.h"
 
+#define RUBY_MAX_SHARED_BUFFER_BYTES (64 * 1024 * 1024)
+
 namespace Ruby
 {
     struct Plane
@@ -29,6 +33,7 @@ namespace Ruby
     };
 
 
+    // the subsets are used by the CPU meshes too, the GPU buffers only exist with D3D
     class MeshGeometry
     {
     public:
@@ -45,20 +50,30 @@ namespace Ruby
     public:
         MeshGeometry();
         ~MeshGeometry();
+        void SetSubsetTable(std::vector<Subset>& subsetTable);
+        std::vector<Subset>& GetSubsetTable();
+#ifdef _WIN32
         template<typename VertexType>
         void SetVertices(ID3D11Device* device, const VertexType* vertices, UINT count);
         void SetIndices(ID3D11Device* device, const USHORT* indices, UINT count);
-        void SetSubsetTable(std::vector<Subset>& subsetTable);
-        std::vector<Subset>& GetSubsetTable();
+        void SetSharedBuffers(ID3D11Buffer* vb, ID3D11Buffer* ib, UINT vertexStride, UINT baseVertex, UINT baseIndex);
+        ID3D11Buffer* GetVertexBuffer();
+        ID3D11Buffer* GetIndexBuffer();
         void Draw(ID3D11DeviceContext* dc, UINT subsetId);
+#endif
     private:
         MeshGeometry(const MeshGeometry& rhs);
         MeshGeometry& operator=(const MeshGeometry& rhs);
     private:
+#ifdef _WIN32
         ID3D11Buffer* mVB;
         ID3D11Buffer* mIB;
         DXGI_FORMAT mIndexBufferFormat;
+#endif
         UINT mVertexStride;
+        // offsets into the buffers when they are shared with other meshes
+        UINT mBaseVertex;
+        UINT mBaseIndex;
         std::vector<Subset> mSubsetTable;
 
         UINT mIndicesCount;
@@ -68,13 +83,21 @@ namespace Ruby
     {
     public:
         Mesh() {};
+        // CPU only, load the vertices, indices, subsets and materials without creating GPU buffers
+        Mesh(const std::string modelFilename,
+            const std::string modelBinFilename);
+#ifdef _WIN32
         Mesh(ID3D11Device* device,
             const std::string modelFilename,
             const std::string modelBinFilename,
             std::string textureFilepath);
+#endif
         ~Mesh();
 
-        Mesh* Clip(ID3D11Device* device, Plane& plane);
+        // CPU only, the result has no GPU buffers. use UploadMeshes on the thread that own the device
+        Mesh* Clip(Plane& plane);
+        // drop the vertices that no index use, Clip keep all the vertices of the source mesh
+        void RemoveUnusedVertices();
         void GetBoundingBox(XMFLOAT3& min, XMFLOAT3& max);
 
         std::vector<Pbr::Material> Mat;
@@ -82,6 +105,12 @@ namespace Ruby
         std::vector<USHORT> Indices;
         MeshGeometry ModelMesh;
     };
+
+#ifdef _WIN32
+    // copy the vertices and indices of all the meshes into a few large buffers
+    // and point each mesh ModelMesh to its range
+    void UploadMeshes(ID3D11Device* device, Mesh** meshes, UINT count);
+#endif
 }
 
 
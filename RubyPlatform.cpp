@@ -0,0 +1,41 @@
+#include "RubyPlatform.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+namespace Ruby
+{
+    FILE* OpenFile(const char* path, const char* mode)
+    {
+#ifdef _WIN32
+        FILE* file = nullptr;
+        fopen_s(&file, path, mode);
+        return file;
+#else
+        return fopen(path, mode);
+#endif
+    }
+
+    void CopyString(char* dest, size_t size, const char* src)
+    {
+        if (size == 0) return;
+        size_t length = strlen(src);
+        if (length > size - 1) length = size - 1;
+        memcpy(dest, src, length);
+        dest[length] = '\0';
+    }
+
+    void DebugPrint(const char* format, ...)
+    {
+        char buffer[1024];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+#ifdef _WIN32
+        OutputDebugStringA(buffer);
+#else
+        fputs(buffer, stderr);
+#endif
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+#include "RubyTypes.h"
+
+// size of the path buffers, MAX_PATH on windows
+#define RUBY_MAX_PATH 260
+
+namespace Ruby
+{
+    // fopen_s on windows and fopen on the others, nullptr if the file could not be open
+    FILE* OpenFile(const char* path, const char* mode);
+    // copy at most size - 1 characters, dest always end with a 0
+    void CopyString(char* dest, size_t size, const char* src);
+    // printf to the debugger output on windows and to stderr on the others
+    void DebugPrint(const char* format, ...);
+}
@@ -10,5 +10,156 @@ namespace Ruby
         return 1;
     }
 
+    void BuildFrustum(XMMATRIX viewProj, Frustum& frustum)
+    {
+        XMFLOAT4X4 m;
+        XMStoreFloat4x4(&m, viewProj);
+
+        // the planes are combinations of the columns of the matrix (Gribb and Hartmann)
+        XMVECTOR col0 = XMVectorSet(m._11, m._21, m._31, m._41);
+        XMVECTOR col1 = XMVectorSet(m._12, m._22, m._32, m._42);
+        XMVECTOR col2 = XMVectorSet(m._13, m._23, m._33, m._43);
+        XMVECTOR col3 = XMVectorSet(m._14, m._24, m._34, m._44);
+
+        XMVECTOR planes[6];
+        planes[0] = col3 + col0; // left
+        planes[1] = col3 - col0; // right
+        planes[2] = col3 + col1; // bottom
+        planes[3] = col3 - col1; // top
+        planes[4] = col2;        // near
+        planes[5] = col3 - col2; // far
+
+        for (int i = 0; i < 6; ++i)
+        {
+            XMStoreFloat4(&frustum.planes[i], XMPlaneNormalize(planes[i]));
+        }
+        frustum.planeCount = 6;
+    }
+
+    void BuildShadowCasterFrustum(XMMATRIX lightViewProj, Frustum& frustum)
+    {
+        BuildFrustum(lightViewProj, frustum);
+        frustum.planes[4] = frustum.planes[5];
+        frustum.planeCount = 5;
+    }
+
+    int TestFrustumAABB(Frustum& frustum, AABB& box, UINT32& planeMask)
+    {
+        int result = RUBY_FRUSTUM_INSIDE;
+        for (UINT32 i = 0; i < frustum.planeCount; ++i)
+        {
+            if ((planeMask & (1 << i)) == 0) continue;
+
+            XMFLOAT4& p = frustum.planes[i];
+            float s = p.x * box.c.x + p.y * box.c.y + p.z * box.c.z + p.w;
+            float e = box.r.x * fabsf(p.x) + box.r.y * fabsf(p.y) + box.r.z * fabsf(p.z);
+            if (s + e < 0.0f) return RUBY_FRUSTUM_OUTSIDE;
+            if (s - e < 0.0f) result = RUBY_FRUSTUM_INTERSECT;
+            else planeMask &= ~(1 << i);
+        }
+        return result;
+    }
+
+    void GetTriangleBounds(Mesh* mesh, std::vector<TriangleBounds>& bounds)
+    {
+        bounds.resize(mesh->Indices.size() / 3);
+        for (int i = 0; i < bounds.size(); ++i)
+        {
+            XMVECTOR a = XMLoadFloat3(&mesh->Vertices[mesh->Indices[i * 3 + 0]].Position);
+            XMVECTOR b = XMLoadFloat3(&mesh->Vertices[mesh->Indices[i * 3 + 1]].Position);
+            XMVECTOR c = XMLoadFloat3(&mesh->Vertices[mesh->Indices[i * 3 + 2]].Position);
+            XMStoreFloat3(&bounds[i].min, XMVectorMin(XMVectorMin(a, b), c));
+            XMStoreFloat3(&bounds[i].max, XMVectorMax(XMVectorMax(a, b), c));
+        }
+    }
+
+    bool Scene::Raycast(XMFLOAT3 o, XMFLOAT3 d, SceneHit& hit)
+    {
+        Physics::Ray ray;
+        ray.o = Physics::Vector3(o.x, o.y, o.z);
+        ray.d = Physics::Vector3(d.x, d.y, d.z);
+
+        bool result = false;
+        SceneStaticObject* first = mStaticObjects.mObjects.data();
+        auto raycastLeaf = [&](SceneStaticObject* objects, UINT32 count, float tMax)
+        {
+            for (UINT32 i = 0; i < count; ++i)
+            {
+                int triangle;
+                float t = objects[i].mBVH.Raycast(&objects[i].mCollision, ray, tMax, triangle);
+                if (t >= 0.0f && t < tMax)
+                {
+                    Physics::Vector3 n = objects[i].mCollision.GetNormal(triangle);
+                    tMax = t;
+                    hit.object = (UINT32)(&objects[i] - first);
+                    hit.triangle = (UINT32)triangle;
+                    hit.t = t;
+                    hit.normal = XMFLOAT3(n.x, n.y, n.z);
+                    result = true;
+                }
+            }
+            return tMax;
+        };
+        mStaticObjects.VisitRay(o, d, 1.0f, 0.0f, raycastLeaf);
+        return result;
+    }
+
+    bool Scene::SweepSphere(XMFLOAT3 c, float radius, XMFLOAT3 d, SceneHit& hit, std::vector<Physics::TriangleRange>& ranges)
+    {
+        Physics::Sphere sphere;
+        sphere.c = Physics::Vector3(c.x, c.y, c.z);
+        sphere.r = radius;
+        Physics::Vector3 movement = Physics::Vector3(d.x, d.y, d.z);
+
+        Physics::Capsule sweep;
+        sweep.a = sphere.c;
+        sweep.b = sphere.c + movement;
+        sweep.r = radius;
+
+        bool result = false;
+        SceneStaticObject* first = mStaticObjects.mObjects.data();
+        auto sweepLeaf = [&](SceneStaticObject* objects, UINT32 count, float tMax)
+        {
+            for (UINT32 i = 0; i < count; ++i)
+            {
+                ranges.clear();
+                objects[i].mBVH.QueryCapsule(&objects[i].mCollision, sweep, ranges);
+
+                Physics::SweepHit sweepHit;
+                if (Physics::SweepSphere(sphere, movement, ranges.data(), (int)ranges.size(), sweepHit) &&
+                    sweepHit.t < tMax)
+                {
+                    tMax = sweepHit.t;
+                    hit.object = (UINT32)(&objects[i] - first);
+                    hit.triangle = (UINT32)sweepHit.triangle;
+                    hit.t = sweepHit.t;
+                    hit.normal = XMFLOAT3(sweepHit.normal.x, sweepHit.normal.y, sweepHit.normal.z);
+                    result = true;
+                }
+            }
+            return tMax;
+        };
+        mStaticObjects.VisitRay(c, d, 1.0f, radius, sweepLeaf);
+        return result;
+    }
+
+    void Scene::LinearizeStaticGeometry()
+    {
+        mStaticObjects.Build(mStaticObjectTree.mRoot);
+        if (mStaticObjectTree.mRoot) delete mStaticObjectTree.mRoot;
+        mStaticObjectTree.mRoot = nullptr;
+    }
+
+#ifdef _WIN32
+    void Scene::UploadStaticGeometry(ID3D11Device* device)
+    {
+        std::vector<Mesh*> meshes;
+        for (int i = 0; i < mStaticObjects.mObjects.size(); ++i)
+        {
+            meshes.push_back(mStaticObjects.mObjects[i].mMesh);
+        }
+        UploadMeshes(device, meshes.data(), meshes.size());
+    }
+#endif
 
 }
\ No newline at end of file
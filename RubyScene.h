@@ -1,8 +1,14 @@
 #pragma once
 #include "RubyMesh.h"
+#include "RubyLooseOctree.h"
 
 #include "RubyDefines.h"
 #include "Physics/Collision.h"
+#include "Physics/TriangleBVH.h"
+#include "Physics/Sweep.h"
+
+#define RUBY_DYNAMIC_TREE_DEPTH 6
+#define RUBY_MAX_DYNAMIC_OBJECTS 4096
 
 namespace Ruby
 {
@@ -15,21 +21,48 @@ namespace Ruby
 
     int TestAABBAABB(AABB& a, AABB& b);
 
+    // planes point inside, a point p is inside when dot(n, p) + d >= 0
+    struct Frustum
+    {
+        XMFLOAT4 planes[6];
+        UINT32 planeCount;
+    };
+
+    #define RUBY_FRUSTUM_OUTSIDE 0
+    #define RUBY_FRUSTUM_INTERSECT 1
+    #define RUBY_FRUSTUM_INSIDE 2
+
+    // extract the planes of a D3D (z from 0 to 1) view projection matrix
+    void BuildFrustum(XMMATRIX viewProj, Frustum& frustum);
+    // same as BuildFrustum without the near plane, so the volume is extruded toward the light
+    // and the casters between the light and the area it covers are not culled
+    void BuildShadowCasterFrustum(XMMATRIX lightViewProj, Frustum& frustum);
+    // planeMask has a bit for every plane that still need to be tested, the planes the
+    // box is fully inside of are removed from it so the children can skip them
+    int TestFrustumAABB(Frustum& frustum, AABB& box, UINT32& planeMask);
+
     class SceneStaticObject
     {
     public:
         XMFLOAT4X4 world;
         Mesh* mMesh;
         std::vector<Ruby::Physics::Triangle> mTriangles;
+        // build with mTriangles, the triangles are sorted in the BVH leaf order
+        Ruby::Physics::TriangleBVH mBVH;
+        // mTriangles baked for the collision queries, in the same order
+        Ruby::Physics::CollisionMesh mCollision;
     };
 
+    // in the adaptive octree a child can be nullptr when its octant is empty,
+    // a node is a leaf only when it has no children at all
     template<typename Type>
     struct OctreeNode
     {
 
         void Query(XMFLOAT3 c, XMFLOAT3 r, std::vector<OctreeNode<Type>*>& result);
+        bool IsLeaf();
 
-
+        OctreeNode() : pChild() {}
         ~OctreeNode();
 
         XMFLOAT3 center;
@@ -45,7 +78,7 @@ namespace Ruby
         AABB b = { center, XMFLOAT3(halfWidth, halfWidth, halfWidth) };
         if (TestAABBAABB(a, b))
         {
-            if (pChild[0] == nullptr)
+            if (IsLeaf())
             {
                 if (pObjList.empty() == false)
                 {
@@ -56,13 +89,23 @@ namespace Ruby
             {
                 for (int i = 0; i < 8; ++i)
                 {
-                    pChild[i]->Query(c, r, result);
+                    if (pChild[i]) pChild[i]->Query(c, r, result);
                 }
             }
         }
 
     }
 
+    template<typename T>
+    bool OctreeNode<T>::IsLeaf()
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            if (pChild[i]) return false;
+        }
+        return true;
+    }
+
     template<typename T>
     OctreeNode<T>::~OctreeNode()
     {
@@ -115,12 +158,103 @@ namespace Ruby
     };
 
 
+    // slab test of the segment o + d * t against the box c, r grow by radius. invD is 1 / d
+    inline bool IntersectRayAABB(XMFLOAT3 o, XMFLOAT3 d, XMFLOAT3 invD, XMFLOAT3 c, XMFLOAT3 r,
+                                 float radius, float tMax, float& tEnter)
+    {
+        float origin[3] = { o.x, o.y, o.z };
+        float dir[3] = { d.x, d.y, d.z };
+        float inv[3] = { invD.x, invD.y, invD.z };
+        float min[3] = { c.x - r.x - radius, c.y - r.y - radius, c.z - r.z - radius };
+        float max[3] = { c.x + r.x + radius, c.y + r.y + radius, c.z + r.z + radius };
+
+        float tMin = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (fabsf(dir[i]) < FLT_EPSILON)
+            {
+                // parallel to the slab
+                if (origin[i] < min[i] || origin[i] > max[i]) return false;
+            }
+            else
+            {
+                float t0 = (min[i] - origin[i]) * inv[i];
+                float t1 = (max[i] - origin[i]) * inv[i];
+                if (t0 > t1) { float temp = t0; t0 = t1; t1 = temp; }
+                if (t0 > tMin) tMin = t0;
+                if (t1 < tMax) tMax = t1;
+                if (tMin > tMax) return false;
+            }
+        }
+        tEnter = tMin;
+        return true;
+    }
+
+    struct TriangleBounds
+    {
+        XMFLOAT3 min;
+        XMFLOAT3 max;
+    };
+
+    void GetTriangleBounds(Mesh* mesh, std::vector<TriangleBounds>& bounds);
+
+    template<typename T>
+    OctreeNode<T>* BuildOctreeAdaptive(XMFLOAT3 center, float halfWidth,
+                                       std::vector<TriangleBounds>& bounds, std::vector<UINT32>& triangles,
+                                       UINT32 maxTriangles, float minHalfWidth)
+    {
+        OctreeNode<T>* pNode = new OctreeNode<T>;
+        pNode->center = center;
+        pNode->halfWidth = halfWidth;
+
+        // only subdivide dense nodes that are still big enough
+        float step = halfWidth * 0.5f;
+        if (triangles.size() <= maxTriangles || step < minHalfWidth)
+        {
+            return pNode;
+        }
+
+        XMFLOAT3 offset;
+        std::vector<UINT32> childTriangles;
+        childTriangles.reserve(triangles.size());
+        for (int i = 0; i < 8; ++i)
+        {
+            offset.x = ((i & 1) ? step : -step);
+            offset.y = ((i & 2) ? step : -step);
+            offset.z = ((i & 4) ? step : -step);
+
+            XMFLOAT3 newCenter = XMFLOAT3(center.x + offset.x, center.y + offset.y, center.z + offset.z);
+
+            // a triangle goes to every child its bounds touch
+            childTriangles.clear();
+            for (int j = 0; j < triangles.size(); ++j)
+            {
+                TriangleBounds& b = bounds[triangles[j]];
+                if (b.min.x > newCenter.x + step || b.max.x < newCenter.x - step) continue;
+                if (b.min.y > newCenter.y + step || b.max.y < newCenter.y - step) continue;
+                if (b.min.z > newCenter.z + step || b.max.z < newCenter.z - step) continue;
+                childTriangles.push_back(triangles[j]);
+            }
+
+            // empty octants dont get a node. the child only read the list, it is clear for the next octant
+            if (childTriangles.empty() == false)
+            {
+                pNode->pChild[i] = BuildOctreeAdaptive<T>(newCenter, step, bounds, childTriangles, maxTriangles, minHalfWidth);
+            }
+        }
+        return pNode;
+    }
+
+
     template<typename Type>
     class Octree
     {
     public:
         OctreeNode<Type>* mRoot;
         Octree(XMFLOAT3 center, float halfWidth, float stopDepth);
+        // adaptive, subdivide a node only while it has more than maxTriangles
+        // triangles of the mesh and its children are not smaller than minHalfWidth
+        Octree(Mesh* mesh, XMFLOAT3 center, float halfWidth, UINT32 maxTriangles, float minHalfWidth);
         ~Octree();
     };
 
@@ -131,20 +265,332 @@ namespace Ruby
         mRoot = BuildOctree<T>(center, halfWidth, stopDepth);
     }
 
+    template<typename T>
+    Octree<T>::Octree(Mesh* mesh, XMFLOAT3 center, float halfWidth, UINT32 maxTriangles, float minHalfWidth)
+    {
+        std::vector<TriangleBounds> bounds;
+        GetTriangleBounds(mesh, bounds);
+
+        std::vector<UINT32> triangles(bounds.size());
+        for (UINT32 i = 0; i < triangles.size(); ++i)
+        {
+            triangles[i] = i;
+        }
+
+        mRoot = BuildOctreeAdaptive<T>(center, halfWidth, bounds, triangles, maxTriangles, minHalfWidth);
+    }
+
     template<typename T>
     Octree<T>::~Octree()
     {
         if (mRoot) delete mRoot;
     }
 
+    // pointerless octree, all the nodes live in one array and the children of a node are
+    // contiguous in Morton order (octant bit 0 = x, bit 1 = y, bit 2 = z) so a child is found with
+    // firstChild + the number of bits of childMask below its octant. the objects are packed in a
+    // side array in depth first order, every node has the range of objects of its whole subtree
+    struct LinearOctreeNode
+    {
+        XMFLOAT3 center;
+        float halfWidth;
+        UINT32 firstChild;
+        UINT32 childMask; // 0 for the leaves
+        UINT32 firstObject;
+        UINT32 objectCount;
+    };
+
+    inline UINT32 CountBits(UINT32 value)
+    {
+        value = value - ((value >> 1) & 0x55555555);
+        value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+        return (((value + (value >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+    }
+
+    template<typename Type>
+    class LinearOctree
+    {
+    public:
+        LinearOctree() {}
+        // move the objects out of the pointer octree, the nodes of the source are left empty
+        void Build(OctreeNode<Type>* root);
+
+        // push the index of every non empty leaf that overlap the box, result is not cleared
+        void Query(XMFLOAT3 c, XMFLOAT3 r, std::vector<UINT32>& result);
+        // same but without allocations, return the number of leaves written to result
+        UINT32 Query(XMFLOAT3 c, XMFLOAT3 r, UINT32* result, UINT32 maxCount);
+        // call visitor(UINT32 leaf) for every non empty leaf that overlap the box
+        template<typename Visitor>
+        void Visit(XMFLOAT3 c, XMFLOAT3 r, Visitor& visitor);
+        // call visitor(Type* objects, UINT32 count, float tMax) for the leaves the segment o + d * t
+        // (t from 0 to tMax) goes through, in front to back order. the visitor return the t of its
+        // closest hit or tMax and the nodes that start after that are skip. radius grow the nodes
+        // for sphere sweeps. return the final tMax
+        template<typename Visitor>
+        float VisitRay(XMFLOAT3 o, XMFLOAT3 d, float tMax, float radius, Visitor& visitor);
+        // call visitor(Type* objects, UINT32 count) for the objects inside the frustum,
+        // a node fully inside pass the objects of its whole subtree in one call
+        template<typename Visitor>
+        void VisitFrustum(Frustum& frustum, Visitor& visitor);
+
+        UINT32 GetChild(UINT32 node, UINT32 octant);
+        LinearOctreeNode& GetNode(UINT32 node) { return mNodes[node]; }
+        Type* GetObjects(UINT32 node) { return mObjects.data() + mNodes[node].firstObject; }
+        UINT32 GetObjectCount(UINT32 node) { return mNodes[node].objectCount; }
+        UINT32 GetNodeCount() { return (UINT32)mNodes.size(); }
+
+        std::vector<LinearOctreeNode> mNodes;
+        std::vector<Type> mObjects;
+    private:
+        void BuildNode(OctreeNode<Type>* node, UINT32 index);
+        template<typename Visitor>
+        void VisitNode(UINT32 index, AABB& box, Visitor& visitor);
+        template<typename Visitor>
+        void VisitRayNode(UINT32 index, XMFLOAT3& o, XMFLOAT3& d, XMFLOAT3& invD,
+                          float radius, float& tMax, Visitor& visitor);
+        template<typename Visitor>
+        void VisitFrustumNode(UINT32 index, Frustum& frustum, UINT32 planeMask, Visitor& visitor);
+    };
+
+    template<typename T>
+    void LinearOctree<T>::Build(OctreeNode<T>* root)
+    {
+        mNodes.clear();
+        mObjects.clear();
+        if (root == nullptr) return;
+        mNodes.resize(1);
+        BuildNode(root, 0);
+    }
+
+    template<typename T>
+    void LinearOctree<T>::BuildNode(OctreeNode<T>* node, UINT32 index)
+    {
+        UINT32 childMask = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            if (node->pChild[i]) childMask |= (1 << i);
+        }
+
+        // the children of this node get allocated together at the end of the array
+        UINT32 firstChild = (UINT32)mNodes.size();
+        mNodes.resize(mNodes.size() + CountBits(childMask));
+
+        LinearOctreeNode& linearNode = mNodes[index];
+        linearNode.center = node->center;
+        linearNode.halfWidth = node->halfWidth;
+        linearNode.firstChild = firstChild;
+        linearNode.childMask = childMask;
+        linearNode.firstObject = (UINT32)mObjects.size();
+
+        for (int i = 0; i < node->pObjList.size(); ++i)
+        {
+            mObjects.push_back(std::move(node->pObjList[i]));
+        }
+        node->pObjList.clear();
+
+        UINT32 child = firstChild;
+        for (int i = 0; i < 8; ++i)
+        {
+            if (node->pChild[i]) BuildNode(node->pChild[i], child++);
+        }
+
+        // mNodes can grow in the recursion so dont use linearNode here
+        mNodes[index].objectCount = (UINT32)mObjects.size() - mNodes[index].firstObject;
+    }
+
+    template<typename T>
+    UINT32 LinearOctree<T>::GetChild(UINT32 node, UINT32 octant)
+    {
+        LinearOctreeNode& linearNode = mNodes[node];
+        return linearNode.firstChild + CountBits(linearNode.childMask & ((1 << octant) - 1));
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    void LinearOctree<T>::Visit(XMFLOAT3 c, XMFLOAT3 r, Visitor& visitor)
+    {
+        if (mNodes.empty()) return;
+        AABB box = { c, r };
+        VisitNode(0, box, visitor);
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    void LinearOctree<T>::VisitNode(UINT32 index, AABB& box, Visitor& visitor)
+    {
+        LinearOctreeNode& node = mNodes[index];
+        AABB b = { node.center, XMFLOAT3(node.halfWidth, node.halfWidth, node.halfWidth) };
+        if (node.objectCount == 0 || !TestAABBAABB(box, b)) return;
+
+        if (node.childMask == 0)
+        {
+            visitor(index);
+        }
+        else
+        {
+            UINT32 childCount = CountBits(node.childMask);
+            for (UINT32 i = 0; i < childCount; ++i)
+            {
+                VisitNode(node.firstChild + i, box, visitor);
+            }
+        }
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    float LinearOctree<T>::VisitRay(XMFLOAT3 o, XMFLOAT3 d, float tMax, float radius, Visitor& visitor)
+    {
+        if (mNodes.empty()) return tMax;
+
+        XMFLOAT3 invD = XMFLOAT3(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+        LinearOctreeNode& root = mNodes[0];
+        float tEnter;
+        if (IntersectRayAABB(o, d, invD, root.center, XMFLOAT3(root.halfWidth, root.halfWidth, root.halfWidth),
+                             radius, tMax, tEnter))
+        {
+            VisitRayNode(0, o, d, invD, radius, tMax, visitor);
+        }
+        return tMax;
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    void LinearOctree<T>::VisitRayNode(UINT32 index, XMFLOAT3& o, XMFLOAT3& d, XMFLOAT3& invD,
+                                       float radius, float& tMax, Visitor& visitor)
+    {
+        LinearOctreeNode& node = mNodes[index];
+        if (node.objectCount == 0) return;
+
+        if (node.childMask == 0)
+        {
+            tMax = visitor(mObjects.data() + node.firstObject, node.objectCount, tMax);
+            return;
+        }
+
+        // sort the children the segment touch by entry distance
+        UINT32 children[8];
+        float enter[8];
+        UINT32 count = 0;
+        UINT32 childCount = CountBits(node.childMask);
+        for (UINT32 i = 0; i < childCount; ++i)
+        {
+            LinearOctreeNode& child = mNodes[node.firstChild + i];
+            float tEnter;
+            if (child.objectCount &&
+                IntersectRayAABB(o, d, invD, child.center, XMFLOAT3(child.halfWidth, child.halfWidth, child.halfWidth),
+                                 radius, tMax, tEnter))
+            {
+                UINT32 j = count++;
+                while (j > 0 && enter[j - 1] > tEnter)
+                {
+                    enter[j] = enter[j - 1];
+                    children[j] = children[j - 1];
+                    --j;
+                }
+                enter[j] = tEnter;
+                children[j] = node.firstChild + i;
+            }
+        }
+
+        for (UINT32 i = 0; i < count; ++i)
+        {
+            // a hit closer than the start of this child end the traversal
+            if (enter[i] > tMax) break;
+            VisitRayNode(children[i], o, d, invD, radius, tMax, visitor);
+        }
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    void LinearOctree<T>::VisitFrustum(Frustum& frustum, Visitor& visitor)
+    {
+        if (mNodes.empty()) return;
+        VisitFrustumNode(0, frustum, (1 << frustum.planeCount) - 1, visitor);
+    }
+
+    template<typename T>
+    template<typename Visitor>
+    void LinearOctree<T>::VisitFrustumNode(UINT32 index, Frustum& frustum, UINT32 planeMask, Visitor& visitor)
+    {
+        LinearOctreeNode& node = mNodes[index];
+        if (node.objectCount == 0) return;
+
+        AABB b = { node.center, XMFLOAT3(node.halfWidth, node.halfWidth, node.halfWidth) };
+        int result = TestFrustumAABB(frustum, b, planeMask);
+        if (result == RUBY_FRUSTUM_OUTSIDE) return;
+
+        if (result == RUBY_FRUSTUM_INSIDE || node.childMask == 0)
+        {
+            visitor(mObjects.data() + node.firstObject, node.objectCount);
+        }
+        else
+        {
+            UINT32 childCount = CountBits(node.childMask);
+            for (UINT32 i = 0; i < childCount; ++i)
+            {
+                VisitFrustumNode(node.firstChild + i, frustum, planeMask, visitor);
+            }
+        }
+    }
+
+    template<typename T>
+    void LinearOctree<T>::Query(XMFLOAT3 c, XMFLOAT3 r, std::vector<UINT32>& result)
+    {
+        auto visitor = [&result](UINT32 leaf) { result.push_back(leaf); };
+        Visit(c, r, visitor);
+    }
+
+    template<typename T>
+    UINT32 LinearOctree<T>::Query(XMFLOAT3 c, XMFLOAT3 r, UINT32* result, UINT32 maxCount)
+    {
+        UINT32 count = 0;
+        auto visitor = [result, maxCount, &count](UINT32 leaf)
+        {
+            if (count < maxCount) result[count++] = leaf;
+        };
+        Visit(c, r, visitor);
+        return count;
+    }
+
+    struct SceneHit
+    {
+        UINT32 object;   // index in Scene::mStaticObjects.mObjects
+        UINT32 triangle; // index in the mTriangles of the object
+        float t;
+        XMFLOAT3 normal;
+    };
+
     class Scene
     {
     public:
         Scene(XMFLOAT3 center, float halfWidth, float stopDepth)
             :
-            mStaticObjectTree(center, halfWidth, stopDepth) {}
+            mStaticObjectTree(center, halfWidth, stopDepth),
+            mDynamicObjectTree(center, halfWidth, RUBY_DYNAMIC_TREE_DEPTH, RUBY_MAX_DYNAMIC_OBJECTS) {}
+        Scene(Mesh* mesh, XMFLOAT3 center, float halfWidth, UINT32 maxTriangles, float minHalfWidth)
+            :
+            mStaticObjectTree(mesh, center, halfWidth, maxTriangles, minHalfWidth),
+            mDynamicObjectTree(center, halfWidth, RUBY_DYNAMIC_TREE_DEPTH, RUBY_MAX_DYNAMIC_OBJECTS) {}
         ~Scene() {}
+
+        // closest hit of the segment o + d * t with t from 0 to 1
+        bool Raycast(XMFLOAT3 o, XMFLOAT3 d, SceneHit& hit);
+        // closest hit of a sphere moving from c to c + d. ranges is scratch owned by the caller so
+        // the query dont allocate, keep one per thread and the queries can run in parallel
+        bool SweepSphere(XMFLOAT3 c, float radius, XMFLOAT3 d, SceneHit& hit, std::vector<Physics::TriangleRange>& ranges);
+
+        // move the split geometry into mStaticObjects and free the build octree
+        void LinearizeStaticGeometry();
+#ifdef _WIN32
+        // create the GPU buffers for all the leaf meshes, call it from the thread that own the device
+        void UploadStaticGeometry(ID3D11Device* device);
+#endif
+
+        // only used while the geometry is split, the queries use mStaticObjects
         Octree<SceneStaticObject> mStaticObjectTree;
+        LinearOctree<SceneStaticObject> mStaticObjects;
+        // objects that move, insert them once and Move them every update
+        LooseOctree mDynamicObjectTree;
     };
 }
 
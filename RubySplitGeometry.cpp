@@ -0,0 +1,106 @@
+#include "RubySplitGeometry.h"
+#include "RubyDefines.h"
+#include "RubyDebugProfiler.h"
+
+namespace Ruby
+{
+    Mesh* ClipMeshToNode(Mesh* mesh, OctreeNode<SceneStaticObject>* node)
+    {
+        float halfWidth = node->halfWidth;
+        XMFLOAT3 center = node->center;
+
+        Ruby::Plane faces[6] = {
+
+            {XMFLOAT3(1, 0,   0), center.x - halfWidth},
+            {XMFLOAT3(-1,  0,  0), -center.x - halfWidth},
+            {XMFLOAT3(0, 1,   0), center.y - halfWidth},
+            {XMFLOAT3(0, -1,  0), -center.y - halfWidth},
+            {XMFLOAT3(0, 0,   1), center.z - halfWidth},
+            {XMFLOAT3(0, 0,  -1), -center.z - halfWidth},
+
+        };
+
+        for (int i = 0; i < 6; ++i)
+        {
+            Ruby::Mesh* tmp = nullptr;
+            if (i > 0) tmp = mesh;
+            mesh = mesh->Clip(faces[i]);
+            if(tmp) delete tmp;
+            if (mesh == nullptr)
+            {
+                break;
+            }
+        }
+        if (mesh != nullptr)
+        {
+            mesh->RemoveUnusedVertices();
+        }
+        return mesh;
+    }
+
+    void BuildStaticObjectTriangles(SceneStaticObject& object)
+    {
+        Mesh* mesh = object.mMesh;
+        object.mTriangles.reserve(mesh->Indices.size() / 3);
+        for (int i = 0; i < mesh->Indices.size(); i += 3)
+        {
+            XMFLOAT3 a = mesh->Vertices[mesh->Indices[i + 0]].Position;
+            XMFLOAT3 b = mesh->Vertices[mesh->Indices[i + 1]].Position;
+            XMFLOAT3 c = mesh->Vertices[mesh->Indices[i + 2]].Position;
+            Ruby::Physics::Triangle triangle;
+            triangle.a = Ruby::Physics::Vector3(a.x, a.y, a.z);
+            triangle.b = Ruby::Physics::Vector3(b.x, b.y, b.z);
+            triangle.c = Ruby::Physics::Vector3(c.x, c.y, c.z);
+            object.mTriangles.push_back(triangle);
+        }
+        object.mBVH.Build(object.mTriangles);
+        object.mCollision.Build(object.mTriangles.data(), (int)object.mTriangles.size());
+    }
+
+    static void SplitGeometryLeaf(Mesh* mesh, OctreeNode<SceneStaticObject>* node, SplitGeometryTicks* ticks)
+    {
+        DebugProfilerBegin(SplitGeometryLeaf);
+        UINT64 start = Clock::ReadOSTimer();
+        DebugProfilerBegin(ClipMeshToNode);
+        Ruby::Mesh* clipped = ClipMeshToNode(mesh, node);
+        DebugProfilerEnd(ClipMeshToNode);
+        UINT64 clipEnd = Clock::ReadOSTimer();
+        if (ticks) ticks->mClip.fetch_add(clipEnd - start);
+
+        if (clipped != nullptr)
+        {
+            SceneStaticObject object{};
+            object.mMesh = clipped;
+            DebugProfilerBegin(BuildStaticObjectTriangles);
+            BuildStaticObjectTriangles(object);
+            DebugProfilerEnd(BuildStaticObjectTriangles);
+            // only this job write to the leaf
+            node->pObjList.push_back(object);
+
+            if (ticks) ticks->mTriangles.fetch_add(Clock::ReadOSTimer() - clipEnd);
+        }
+        DebugProfilerEnd(SplitGeometryLeaf);
+    }
+
+    void AddSplitGeometryJobs(JobSystem* jobs, Mesh* mesh, OctreeNode<SceneStaticObject>* node,
+                              JobCounter* counter, SplitGeometryTicks* ticks)
+    {
+        if (node->IsLeaf())
+        {
+            jobs->Run([mesh, node, ticks]() { SplitGeometryLeaf(mesh, node, ticks); }, counter);
+        }
+        else
+        {
+            // the children are added from a job too, so deep trees are walk by all the threads.
+            // the job add its children to the counter before it finish, so it never get to zero early
+            jobs->Run([jobs, mesh, node, counter, ticks]()
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    if (node->pChild[i]) AddSplitGeometryJobs(jobs, mesh, node->pChild[i], counter, ticks);
+                }
+            }, counter);
+        }
+    }
+
+}
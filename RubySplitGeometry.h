@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include "RubyTypes.h"
+#include "RubyScene.h"
+#include "RubyJobSystem.h"
+
+namespace Ruby
+{
+    // time spend by all the jobs in each stage of the split, in OS timer ticks
+    struct SplitGeometryTicks
+    {
+        std::atomic<UINT64> mClip;
+        std::atomic<UINT64> mTriangles;
+
+        SplitGeometryTicks() : mClip(0), mTriangles(0) {};
+    };
+
+    // clip the mesh to the six faces of the node, return nullptr if nothing is left
+    Mesh* ClipMeshToNode(Mesh* mesh, OctreeNode<SceneStaticObject>* node);
+    // fill the collision triangles of the object with the triangles of its mesh
+    void BuildStaticObjectTriangles(SceneStaticObject& object);
+
+    // add the jobs that clip the mesh to every leaf under node and add the result to the
+    // object list of the leaf. the jobs only do CPU work, the GPU buffers are created later
+    // in the thread that own the device (see Scene::UploadStaticGeometry). ticks can be nullptr
+    void AddSplitGeometryJobs(JobSystem* jobs, Mesh* mesh, OctreeNode<SceneStaticObject>* node,
+                              JobCounter* counter, SplitGeometryTicks* ticks);
+}
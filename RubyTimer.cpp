@@ -1,4 +1,3 @@
-#include <Windows.h>
 #include "RubyTimer.h"
 
 namespace Ruby
@@ -14,9 +13,7 @@ namespace Ruby
         mStopTime(0),
         mStopped(false)
     {
-        __int64 countPerSec;
-        QueryPerformanceFrequency((LARGE_INTEGER*)&countPerSec);
-        mSecondsPerCount = 1.0 / (double)countPerSec;
+        mSecondsPerCount = 1.0 / (double)Clock::GetOSFrequency();
     }
 
     float Timer::TotalTime()
@@ -38,8 +35,7 @@ namespace Ruby
 
     void Timer::Reset()
     {
-        __int64 currTime;
-        QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+        INT64 currTime = (INT64)Clock::ReadOSTimer();
         mBaseTime = currTime;
         mPrevTime = currTime;
         mStopTime = 0;
@@ -48,8 +44,7 @@ namespace Ruby
 
     void Timer::Start()
     {
-        __int64 startTime;
-        QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+        INT64 startTime = (INT64)Clock::ReadOSTimer();
 
         if (mStopped)
         {
@@ -65,8 +60,7 @@ namespace Ruby
     {
         if (!mStopped)
         {
-            __int64 currTime;
-            QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+            INT64 currTime = (INT64)Clock::ReadOSTimer();
 
             mStopTime = currTime;
             mStopped = true;
@@ -80,8 +74,7 @@ namespace Ruby
             mDeltaTime = 0.0;
             return;
         }
-        __int64 currTime;
-        QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+        INT64 currTime = (INT64)Clock::ReadOSTimer();
         mCurrTime = currTime;
 
         mDeltaTime = (mCurrTime - mPrevTime) * mSecondsPerCount;
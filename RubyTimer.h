@@ -1,5 +1,7 @@
 #pragma once
 
+#include "RubyClock.h"
+
 namespace Ruby
 {
     class Timer
@@ -18,11 +20,11 @@ namespace Ruby
         double mSecondsPerCount;
         double mDeltaTime;
 
-        __int64 mBaseTime;
-        __int64 mPausedTime;
-        __int64 mStopTime;
-        __int64 mPrevTime;
-        __int64 mCurrTime;
+        INT64 mBaseTime;
+        INT64 mPausedTime;
+        INT64 mStopTime;
+        INT64 mPrevTime;
+        INT64 mCurrTime;
 
         bool mStopped;
     };
@@ -0,0 +1,16 @@
+#pragma once
+
+// the integer types of windows.h, the other platforms get them from stdint.h so the
+// code that dont talk to the OS can build without windows.h
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdint.h>
+typedef uint8_t UINT8;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+#endif
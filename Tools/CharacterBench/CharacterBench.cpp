@@ -0,0 +1,231 @@
+// CharacterBench: headless CharacterWorld benchmark. load a glTF from assets/, split and
+// linearize it like FPSDemo::Init, drop N capsule characters on the level and step them at
+// 120 Hz, first on the main thread and then as jobs. the final state of both
+// runs has to be the same bit for bit. no D3D device is created.
+//
+// usage: CharacterBench <model> [-agents N] [-steps N] [-threads N] [-depth N] [-seed N]
+//        <model> is the name of the asset, ./assets/<model>.gltf and ./assets/<model>.bin
+
+#include "../../RubyMesh.h"
+#include "../../RubyScene.h"
+#include "../../RubySplitGeometry.h"
+#include "../../RubyCharacterWorld.h"
+#include "../../RubyClock.h"
+#include "../../RubyDebugProfiler.h"
+#include "../../RubyDefines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define BENCH_FIX_DT (1.0f / 120.0f)
+// steps between input changes of a character
+#define BENCH_INPUT_STEPS 120
+
+static double TicksToMs(UINT64 ticks)
+{
+    return (double)ticks * 1000.0 / (double)Ruby::Clock::GetOSFrequency();
+}
+
+// the inputs only depend on the character and the step so both runs get the same ones
+static UINT32 Hash(UINT32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static float RandomFloat(UINT32& state)
+{
+    state = state * 1664525 + 1013904223;
+    return (float)(state >> 8) / (float)(1 << 24);
+}
+
+static void SetInputs(Ruby::CharacterWorld* world, UINT32 step, UINT32 seed)
+{
+    for (UINT32 i = 0; i < world->GetCharacterCount(); ++i)
+    {
+        Ruby::Character& character = world->GetCharacter(i);
+        UINT32 h = Hash(seed ^ Hash(i * 9781 + (step + i) / BENCH_INPUT_STEPS));
+        float angle = (float)(h & 0xFFFF) / 65536.0f * XM_2PI;
+        character.mMovement = XMFLOAT3(cosf(angle), 0.0f, sinf(angle));
+        character.mJump = (Hash(h + step) & 255) == 0;
+    }
+}
+
+static void AddCharacters(Ruby::CharacterWorld* world, Ruby::Scene* scene, XMFLOAT3 min, XMFLOAT3 max,
+                          UINT32 count, UINT32 seed)
+{
+    const float radius = 0.4f;
+    const float halfHeight = 0.5f;
+    UINT32 state = seed;
+    UINT32 tries = 0;
+    while (world->GetCharacterCount() < count && tries < count * 64)
+    {
+        ++tries;
+        // spawn on the first surface under a random point over the level
+        float x = min.x + (max.x - min.x) * RandomFloat(state);
+        float z = min.z + (max.z - min.z) * RandomFloat(state);
+        XMFLOAT3 o = XMFLOAT3(x, max.y + 1.0f, z);
+        XMFLOAT3 d = XMFLOAT3(0.0f, min.y - max.y - 2.0f, 0.0f);
+        Ruby::SceneHit hit;
+        if (scene->Raycast(o, d, hit) && hit.normal.y > 0.7f)
+        {
+            XMFLOAT3 position = XMFLOAT3(o.x, o.y + d.y * hit.t + halfHeight + radius + 0.05f, o.z);
+            world->AddCharacter(position, radius, halfHeight, 20.0f, 5.0f);
+        }
+    }
+}
+
+static UINT64 RunSteps(Ruby::CharacterWorld* world, Ruby::JobSystem* jobs,
+                       UINT32 steps, UINT32 seed, UINT64& worstStepTicks)
+{
+    worstStepTicks = 0;
+    UINT64 start = Ruby::Clock::ReadOSTimer();
+    for (UINT32 step = 0; step < steps; ++step)
+    {
+        UINT64 stepStart = Ruby::Clock::ReadOSTimer();
+        SetInputs(world, step, seed);
+        world->Step(BENCH_FIX_DT, jobs);
+        UINT64 stepTicks = Ruby::Clock::ReadOSTimer() - stepStart;
+        if (stepTicks > worstStepTicks) worstStepTicks = stepTicks;
+    }
+    return Ruby::Clock::ReadOSTimer() - start;
+}
+
+static UINT32 CountGrounded(Ruby::CharacterWorld* world)
+{
+    UINT32 count = 0;
+    for (UINT32 i = 0; i < world->GetCharacterCount(); ++i)
+    {
+        if (world->GetCharacter(i).mGrounded) ++count;
+    }
+    return count;
+}
+
+static bool SameState(Ruby::CharacterWorld* a, Ruby::CharacterWorld* b)
+{
+    for (UINT32 i = 0; i < a->GetCharacterCount(); ++i)
+    {
+        Ruby::Character& ca = a->GetCharacter(i);
+        Ruby::Character& cb = b->GetCharacter(i);
+        if (memcmp(&ca.mPosition, &cb.mPosition, sizeof(XMFLOAT3)) != 0 ||
+            memcmp(&ca.mVelocity, &cb.mVelocity, sizeof(XMFLOAT3)) != 0 ||
+            ca.mGrounded != cb.mGrounded)
+        {
+            printf("character %u is different\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: CharacterBench <model> [-agents N] [-steps N] [-threads N] [-depth N] [-seed N]\n");
+        return 1;
+    }
+
+    std::string model = argv[1];
+    int agentCount = 1000;
+    int steps = 1200;
+    int threadCount = (int)Ruby::JobSystem::GetDefaultThreadCount();
+    int depth = 3;
+    UINT32 seed = 1234;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-agents") == 0 && i + 1 < argc) agentCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc) steps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-depth") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) seed = (UINT32)atoi(argv[++i]);
+        else
+        {
+            printf("unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (agentCount < 1) agentCount = 1;
+    if (steps < 1) steps = 1;
+    if (threadCount < 1) threadCount = 1;
+
+    std::string gltfPath = "./assets/" + model + ".gltf";
+    std::string binPath = "./assets/" + model + ".bin";
+
+    // the main thread also runs jobs in Wait, so N threads means N - 1 workers
+    Ruby::JobSystem* jobs = new Ruby::JobSystem((UINT32)threadCount);
+
+    Ruby::Mesh* mesh = new Ruby::Mesh(gltfPath, binPath);
+    if (mesh->Vertices.empty())
+    {
+        printf("Error loading model: %s\n", gltfPath.c_str());
+        return 1;
+    }
+
+    XMFLOAT3 min, max;
+    mesh->GetBoundingBox(min, max);
+    XMFLOAT3 center = XMFLOAT3((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+    float halfWidth = max.x - min.x;
+    if (max.y - min.y > halfWidth) halfWidth = max.y - min.y;
+    if (max.z - min.z > halfWidth) halfWidth = max.z - min.z;
+    halfWidth = halfWidth * 0.5f + 1.0f;
+
+    UINT64 splitStart = Ruby::Clock::ReadOSTimer();
+    Ruby::Scene* scene = new Ruby::Scene(center, halfWidth, (float)depth);
+    Ruby::JobCounter counter;
+    Ruby::AddSplitGeometryJobs(jobs, mesh, scene->mStaticObjectTree.mRoot, &counter, nullptr);
+    jobs->Wait(&counter);
+    scene->LinearizeStaticGeometry();
+    UINT64 splitTicks = Ruby::Clock::ReadOSTimer() - splitStart;
+
+    printf("model: %s, triangles: %zu, depth: %d, split %.3f ms\n",
+           model.c_str(), mesh->Indices.size() / 3, depth, TicksToMs(splitTicks));
+
+    Ruby::CharacterWorld* serial = new Ruby::CharacterWorld(&scene->mStaticObjects);
+    Ruby::CharacterWorld* parallel = new Ruby::CharacterWorld(&scene->mStaticObjects);
+    AddCharacters(serial, scene, min, max, (UINT32)agentCount, seed);
+    AddCharacters(parallel, scene, min, max, (UINT32)agentCount, seed);
+    if (serial->GetCharacterCount() == 0)
+    {
+        printf("no place to spawn the characters\n");
+        return 1;
+    }
+
+    printf("agents: %u, steps: %d (%.1f s at 120 Hz), threads: %d\n",
+           serial->GetCharacterCount(), steps, steps * BENCH_FIX_DT, threadCount);
+
+    UINT64 serialWorst, parallelWorst;
+    UINT64 serialTicks = RunSteps(serial, nullptr, (UINT32)steps, seed, serialWorst);
+    UINT64 parallelTicks = RunSteps(parallel, jobs, (UINT32)steps, seed, parallelWorst);
+
+    printf("1 thread: %.3f ms, %.4f ms per step, worst step %.4f ms\n",
+           TicksToMs(serialTicks), TicksToMs(serialTicks) / steps, TicksToMs(serialWorst));
+    printf("%d threads: %.3f ms, %.4f ms per step, worst step %.4f ms, speedup %.2fx\n",
+           threadCount, TicksToMs(parallelTicks), TicksToMs(parallelTicks) / steps,
+           TicksToMs(parallelWorst), (double)serialTicks / (double)parallelTicks);
+    printf("grounded: %u of %u\n", CountGrounded(parallel), parallel->GetCharacterCount());
+
+    bool same = SameState(serial, parallel);
+    printf("deterministic: %s\n", same ? "yes" : "NO");
+
+    delete serial;
+    delete parallel;
+    for (int i = 0; i < scene->mStaticObjects.mObjects.size(); ++i)
+    {
+        SAFE_DELETE(scene->mStaticObjects.mObjects[i].mMesh);
+    }
+    SAFE_DELETE(scene);
+    SAFE_DELETE(mesh);
+    delete jobs;
+    Ruby::DebugProfiler::Shutdown();
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// SplitGeometry: headless version of the level split done in FPSDemo::Init.
+// load a glTF from assets/, split it into an octree with N threads, write the
+// leaves to a file and print the time of each stage. no D3D device is created.
+//
+// usage: SplitGeometry <model> [-depth N] [-maxtris N] [-minsize f] [-threads N] [-runs N] [-out file]
+//        <model> is the name of the asset, ./assets/<model>.gltf and ./assets/<model>.bin
+//        -maxtris build the adaptive octree (subdivide while a node has more than N
+//        triangles and its children half width is at least -minsize) instead of a full one
+
+#include "../../RubyMesh.h"
+#include "../../RubyScene.h"
+#include "../../RubySplitGeometry.h"
+#include "../../RubyClock.h"
+#include "../../RubyDebugProfiler.h"
+#include "../../RubyPlatform.h"
+#include "../../RubyDefines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct SplitStats
+{
+    UINT32 leafCount;
+    UINT64 vertexCount;
+    UINT64 indexCount;
+    UINT64 triangleCount;
+};
+
+static double TicksToMs(UINT64 ticks)
+{
+    return (double)ticks * 1000.0 / (double)Ruby::Clock::GetOSFrequency();
+}
+
+static void CollectLeaves(Ruby::OctreeNode<Ruby::SceneStaticObject>* node,
+                          std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*>& leaves)
+{
+    if (node->IsLeaf())
+    {
+        leaves.push_back(node);
+    }
+    else
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            if (node->pChild[i]) CollectLeaves(node->pChild[i], leaves);
+        }
+    }
+}
+
+static SplitStats GetStats(std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*>& leaves)
+{
+    SplitStats stats{};
+    for (int i = 0; i < leaves.size(); ++i)
+    {
+        for (int j = 0; j < leaves[i]->pObjList.size(); ++j)
+        {
+            Ruby::SceneStaticObject& object = leaves[i]->pObjList[j];
+            ++stats.leafCount;
+            stats.vertexCount += object.mMesh->Vertices.size();
+            stats.indexCount += object.mMesh->Indices.size();
+            stats.triangleCount += object.mTriangles.size();
+        }
+    }
+    return stats;
+}
+
+// file layout (little endian):
+// "RUBYSPLT" UINT32 version UINT32 leafCount
+// for each leaf with geometry:
+//   float center[3] float halfWidth
+//   UINT32 vertexCount UINT32 indexCount UINT32 subsetCount UINT32 triangleCount
+//   Vertex vertices[vertexCount] USHORT indices[indexCount]
+//   Subset subsets[subsetCount] float triangles[triangleCount][9]
+static bool WriteSplit(const char* path, std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*>& leaves, UINT32 leafCount)
+{
+    FILE* file = Ruby::OpenFile(path, "wb");
+    if (!file)
+    {
+        printf("Error opening file: %s\n", path);
+        return false;
+    }
+
+    UINT32 version = 1;
+    fwrite("RUBYSPLT", 1, 8, file);
+    fwrite(&version, sizeof(UINT32), 1, file);
+    fwrite(&leafCount, sizeof(UINT32), 1, file);
+
+    for (int i = 0; i < leaves.size(); ++i)
+    {
+        Ruby::OctreeNode<Ruby::SceneStaticObject>* leaf = leaves[i];
+        for (int j = 0; j < leaf->pObjList.size(); ++j)
+        {
+            Ruby::SceneStaticObject& object = leaf->pObjList[j];
+            Ruby::Mesh* mesh = object.mMesh;
+            std::vector<Ruby::MeshGeometry::Subset>& subsets = mesh->ModelMesh.GetSubsetTable();
+
+            UINT32 counts[4] = {
+                (UINT32)mesh->Vertices.size(), (UINT32)mesh->Indices.size(),
+                (UINT32)subsets.size(), (UINT32)object.mTriangles.size()
+            };
+            fwrite(&leaf->center, sizeof(XMFLOAT3), 1, file);
+            fwrite(&leaf->halfWidth, sizeof(float), 1, file);
+            fwrite(counts, sizeof(UINT32), 4, file);
+            fwrite(mesh->Vertices.data(), sizeof(Ruby::Vertex), mesh->Vertices.size(), file);
+            fwrite(mesh->Indices.data(), sizeof(USHORT), mesh->Indices.size(), file);
+            fwrite(subsets.data(), sizeof(Ruby::MeshGeometry::Subset), subsets.size(), file);
+            for (int k = 0; k < object.mTriangles.size(); ++k)
+            {
+                Ruby::Physics::Triangle& t = object.mTriangles[k];
+                float positions[9] = { t.a.x, t.a.y, t.a.z, t.b.x, t.b.y, t.b.z, t.c.x, t.c.y, t.c.z };
+                fwrite(positions, sizeof(float), 9, file);
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void DeleteLeafMeshes(std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*>& leaves)
+{
+    for (int i = 0; i < leaves.size(); ++i)
+    {
+        for (int j = 0; j < leaves[i]->pObjList.size(); ++j)
+        {
+            SAFE_DELETE(leaves[i]->pObjList[j].mMesh);
+        }
+        leaves[i]->pObjList.clear();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: SplitGeometry <model> [-depth N] [-maxtris N] [-minsize f] [-threads N] [-runs N] [-out file]\n");
+        return 1;
+    }
+
+    std::string model = argv[1];
+    int depth = 3;
+    int maxTriangles = 0;
+    float minHalfWidth = 1.0f;
+    int threadCount = (int)Ruby::JobSystem::GetDefaultThreadCount();
+    int runs = 1;
+    const char* outPath = nullptr;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-depth") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-maxtris") == 0 && i + 1 < argc) maxTriangles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-minsize") == 0 && i + 1 < argc) minHalfWidth = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else
+        {
+            printf("unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threadCount < 1) threadCount = 1;
+    if (runs < 1) runs = 1;
+
+    std::string gltfPath = "./assets/" + model + ".gltf";
+    std::string binPath = "./assets/" + model + ".bin";
+
+    // the main thread also runs jobs in Wait, so N threads means N - 1 workers
+    Ruby::JobSystem* jobs = new Ruby::JobSystem((UINT32)threadCount);
+
+    // parse
+    UINT64 parseStart = Ruby::Clock::ReadOSTimer();
+    Ruby::Mesh* mesh = new Ruby::Mesh(gltfPath, binPath);
+    UINT64 parseTicks = Ruby::Clock::ReadOSTimer() - parseStart;
+
+    if (mesh->Vertices.empty())
+    {
+        printf("Error loading model: %s\n", gltfPath.c_str());
+        return 1;
+    }
+
+    XMFLOAT3 min, max;
+    mesh->GetBoundingBox(min, max);
+    XMFLOAT3 center = XMFLOAT3((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+    float halfWidth = max.x - min.x;
+    if (max.y - min.y > halfWidth) halfWidth = max.y - min.y;
+    if (max.z - min.z > halfWidth) halfWidth = max.z - min.z;
+    halfWidth = halfWidth * 0.5f + 1.0f;
+
+    printf("model: %s, vertices: %zu, triangles: %zu\n", model.c_str(), mesh->Vertices.size(), mesh->Indices.size() / 3);
+    if (maxTriangles > 0)
+    {
+        printf("adaptive max triangles: %d, min half width: %f, threads: %d, runs: %d\n", maxTriangles, minHalfWidth, threadCount, runs);
+    }
+    else
+    {
+        printf("depth: %d, threads: %d, runs: %d\n", depth, threadCount, runs);
+    }
+
+    UINT64 bestBinTicks = (UINT64)-1;
+    UINT64 bestSplitTicks = (UINT64)-1;
+    UINT64 bestClipTicks = (UINT64)-1;
+    UINT64 bestTrianglesTicks = (UINT64)-1;
+    for (int run = 0; run < runs; ++run)
+    {
+        // bin: build the octree and add one job per leaf
+        UINT64 binStart = Ruby::Clock::ReadOSTimer();
+        Ruby::Scene* scene = nullptr;
+        if (maxTriangles > 0)
+        {
+            scene = new Ruby::Scene(mesh, center, halfWidth, (UINT32)maxTriangles, minHalfWidth);
+        }
+        else
+        {
+            scene = new Ruby::Scene(center, halfWidth, (float)depth);
+        }
+        Ruby::SplitGeometryTicks ticks;
+        Ruby::JobCounter counter;
+        Ruby::AddSplitGeometryJobs(jobs, mesh, scene->mStaticObjectTree.mRoot, &counter, &ticks);
+        UINT64 binTicks = Ruby::Clock::ReadOSTimer() - binStart;
+
+        // clip + triangle extraction, running in all the threads
+        UINT64 splitStart = Ruby::Clock::ReadOSTimer();
+        jobs->Wait(&counter);
+        UINT64 splitTicks = Ruby::Clock::ReadOSTimer() - splitStart;
+
+        UINT64 clipTicks = ticks.mClip.load();
+        UINT64 trianglesTicks = ticks.mTriangles.load();
+
+        std::vector<Ruby::OctreeNode<Ruby::SceneStaticObject>*> leaves;
+        CollectLeaves(scene->mStaticObjectTree.mRoot, leaves);
+        SplitStats stats = GetStats(leaves);
+
+        printf("run %d: bin %.3f ms, split %.3f ms (clip %.3f ms, triangles %.3f ms summed over threads)\n",
+               run, TicksToMs(binTicks), TicksToMs(splitTicks), TicksToMs(clipTicks), TicksToMs(trianglesTicks));
+
+        if (run == 0)
+        {
+            printf("leaves: %zu, with geometry: %u, vertices: %llu, indices: %llu, triangles: %llu\n",
+                   leaves.size(), stats.leafCount, (unsigned long long)stats.vertexCount,
+                   (unsigned long long)stats.indexCount, (unsigned long long)stats.triangleCount);
+            if (outPath && WriteSplit(outPath, leaves, stats.leafCount))
+            {
+                printf("written: %s\n", outPath);
+            }
+        }
+
+        if (binTicks < bestBinTicks) bestBinTicks = binTicks;
+        if (splitTicks < bestSplitTicks) bestSplitTicks = splitTicks;
+        if (clipTicks < bestClipTicks) bestClipTicks = clipTicks;
+        if (trianglesTicks < bestTrianglesTicks) bestTrianglesTicks = trianglesTicks;
+
+        DeleteLeafMeshes(leaves);
+        SAFE_DELETE(scene);
+    }
+
+    printf("best: parse %.3f ms, bin %.3f ms, split %.3f ms (clip %.3f ms, triangles %.3f ms summed over threads)\n",
+           TicksToMs(parseTicks), TicksToMs(bestBinTicks), TicksToMs(bestSplitTicks),
+           TicksToMs(bestClipTicks), TicksToMs(bestTrianglesTicks));
+
+    SAFE_DELETE(mesh);
+    delete jobs;
+    Ruby::DebugProfiler::Shutdown();
+
+    return 0;
+}